@@ -0,0 +1,84 @@
+/*************************************************************************/
+/* accept-bench.cpp - benchmark for connecting ports via visitors        */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+  @file accept-bench.cpp
+  measures the cost per port connection of accept(), compared to the
+  former dynamic_cast based accept functions
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <spa/audio.h>
+
+//! port that can also be visited the old way, using RTTI
+class bench_port : public spa::audio::control_in<float>
+{
+public:
+	void accept_rtti(spa::visitor& v) {
+		dynamic_cast<spa::audio::visitor&>(v).visit(*this); }
+};
+
+struct bench_visitor : public virtual spa::audio::visitor
+{
+	using spa::audio::visitor::visit;
+	float value = 0.0f;
+	unsigned connected = 0;
+	void visit(spa::audio::control_in<float>& p) override {
+		p.set_ref(&value);
+		++connected;
+	}
+};
+
+template<class F>
+double ns_per_port(std::vector<bench_port>& ports, unsigned rounds, F&& f)
+{
+	using clock = std::chrono::steady_clock;
+	const clock::time_point start = clock::now();
+	for(unsigned r = 0; r < rounds; ++r)
+		for(bench_port& p : ports)
+			f(p);
+	const std::chrono::duration<double, std::nano> elapsed =
+		clock::now() - start;
+	return elapsed.count() / (double(rounds) * ports.size());
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t n_ports = (argc > 1) ? std::atoi(argv[1]) : 10000;
+	const unsigned rounds = 100;
+
+	std::vector<bench_port> ports(n_ports);
+	bench_visitor v;
+
+	const double rtti = ns_per_port(ports, rounds,
+		[&](bench_port& p) { p.accept_rtti(v); });
+	const double ids = ns_per_port(ports, rounds,
+		[&](bench_port& p) { p.accept(v); });
+
+	std::cout << "ports: " << n_ports << ", rounds: " << rounds
+		<< std::endl
+		<< "dynamic_cast: " << rtti << " ns per port" << std::endl
+		<< "visitor_cast: " << ids << " ns per port" << std::endl;
+
+	return (v.connected == 2 * rounds * n_ports)
+		? EXIT_SUCCESS : EXIT_FAILURE;
+}
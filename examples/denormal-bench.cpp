@@ -0,0 +1,91 @@
+/*************************************************************************/
+/* denormal-bench.cpp - benchmark for subnormal floats in plugins        */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+  @file denormal-bench.cpp
+  runs a bank of decaying resonators, which is fed an impulse and then
+  silence, such that its tail decays into subnormals, once with and once
+  without spa::audio::denormal_guard
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <spa/audio_host.h>
+
+//! bank of feedback filters, like the tail of a reverb
+class tail_plugin : public spa::plugin
+{
+	std::vector<float> state;
+public:
+	const unsigned buffersize = 256;
+	std::vector<float> input, output;
+
+	void run() override
+	{
+		for(unsigned i = 0; i < buffersize; ++i)
+		{
+			float sum = 0.f;
+			for(float& s : state)
+				sum += (s = s * 0.999f + input[i]);
+			output[i] = sum;
+		}
+	}
+
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	tail_plugin() : state(64), input(buffersize), output(buffersize) {}
+};
+
+//! feed an impulse, then run @p blocks blocks of silence
+//! @return the time of the silent blocks
+double bench(bool flush, unsigned blocks)
+{
+	tail_plugin plug;
+	plug.input[0] = 1.f;
+	plug.run();
+	plug.input[0] = 0.f;
+
+	using clock = std::chrono::steady_clock;
+	const clock::time_point start = clock::now();
+	for(unsigned b = 0; b < blocks; ++b)
+	{
+		spa::audio::denormal_guard guard(flush);
+		plug.run();
+	}
+	const std::chrono::duration<double> elapsed = clock::now() - start;
+	return elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+	// 0.999^n reaches the subnormals after ~87000 samples, so most of
+	// the blocks process subnormals without the guard
+	const unsigned blocks = (argc > 1) ? std::atoi(argv[1]) : 2000;
+
+	const double with_subnormals = bench(false, blocks),
+		flushed = bench(true, blocks);
+	std::cout << blocks << " blocks of decaying tail" << std::endl
+		<< "  with subnormals: " << with_subnormals << " s" << std::endl
+		<< "  flushed to zero: " << flushed << " s" << std::endl
+		<< "  speedup: " << with_subnormals / flushed << std::endl;
+	return EXIT_SUCCESS;
+}
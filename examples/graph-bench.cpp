@@ -0,0 +1,118 @@
+/*************************************************************************/
+/* graph-bench.cpp - benchmark for multi-core plugin graphs              */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+  @file graph-bench.cpp
+  runs a session of many tracks, each being a chain of plugins that ends in
+  one master plugin, with different numbers of threads
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <spa/graph.h>
+
+//! plugin that burns some CPU and checks the order of execution
+class bench_plugin : public spa::plugin
+{
+	std::vector<float> state;
+public:
+	const std::vector<bench_plugin*> inputs;
+	unsigned runs = 0;
+	bool order_ok = true;
+
+	void run() override
+	{
+		for(const bench_plugin* in : inputs)
+			order_ok = order_ok && (in->runs == runs + 1);
+		float x = static_cast<float>(runs);
+		for(float& s : state)
+			s = x = s * 0.99f + x * 0.01f;
+		++runs;
+	}
+
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	bench_plugin(std::vector<bench_plugin*> inputs) :
+		state(4096), inputs(std::move(inputs)) {}
+};
+
+int main(int argc, char** argv)
+{
+	const unsigned tracks = (argc > 1) ? std::atoi(argv[1]) : 64,
+		chain = 4, periods = 200;
+	const unsigned max_workers = std::thread::hardware_concurrency()
+		? std::thread::hardware_concurrency() - 1 : 0;
+
+	std::vector<std::unique_ptr<bench_plugin>> plugins;
+	spa::graph g;
+	std::vector<bench_plugin*> track_ends;
+	std::vector<spa::graph::node_id> end_ids;
+	for(unsigned t = 0; t < tracks; ++t)
+	{
+		bench_plugin* prev = nullptr;
+		spa::graph::node_id prev_id = 0;
+		for(unsigned c = 0; c < chain; ++c)
+		{
+			std::vector<bench_plugin*> inputs;
+			if(prev)
+				inputs.push_back(prev);
+			plugins.emplace_back(new bench_plugin(inputs));
+			spa::graph::node_id id = g.add(*plugins.back());
+			if(prev)
+				g.connect(prev_id, id);
+			prev = plugins.back().get();
+			prev_id = id;
+		}
+		track_ends.push_back(prev);
+		end_ids.push_back(prev_id);
+	}
+	plugins.emplace_back(new bench_plugin(track_ends));
+	spa::graph::node_id master = g.add(*plugins.back());
+	for(spa::graph::node_id id : end_ids)
+		g.connect(id, master);
+
+	std::cout << "plugins: " << g.size() << ", periods: " << periods
+		<< std::endl;
+	for(unsigned workers = 0; workers <= max_workers;
+		workers = workers ? workers * 2 : 1)
+	{
+		for(const std::unique_ptr<bench_plugin>& p : plugins)
+			p->runs = 0;
+		g.start(workers);
+		using clock = std::chrono::steady_clock;
+		const clock::time_point start = clock::now();
+		for(unsigned i = 0; i < periods; ++i)
+			g.process();
+		const std::chrono::duration<double, std::micro> elapsed =
+			clock::now() - start;
+		g.stop();
+		std::cout << "threads: " << g.threads() << ", "
+			<< elapsed.count() / periods << " us per period"
+			<< std::endl;
+	}
+
+	for(const std::unique_ptr<bench_plugin>& p : plugins)
+		if(!p->order_ok || !p->runs)
+			return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
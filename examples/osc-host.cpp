@@ -31,23 +31,49 @@
 #include <dlfcn.h>
 #include <cmath>
 #include <memory>
+#include <chrono>
+#include <cstdio>
 #include <spa/audio.h>
+#include <spa/audio_host.h>
+#include <spa/audio_render.h>
+#include <spa/host.h>
+#include <spa/rtcheck.h>
 
 class osc_host
 {
 	friend struct host_visitor;
 public:
-	osc_host(const char* library_name);
+	osc_host(const char* library_name,
+		unsigned buffersize = buffersize_fix);
 	~osc_host();
 
+	//! periods with input, after which play() only gives silence
+	constexpr static int active_periods = 10;
+
 	//! play the @p time'th time, i.e. 0, 1, 2...
 	void play(int time);
 
+	//! render @p frames frames of a sine through the plugin, as fast as
+	//! possible, into the file @p outfile (WAV or raw)
+	//! @param automation_file OSC automation to send, or nullptr
+	//! @return false if the plugin can not be rendered offline
+	bool render(const char* outfile, unsigned long long frames,
+		const char* automation_file);
+	//! read a file written by render() back and print its number of
+	//! frames and the frames where the gain (output / input) changes
+	//! @return false if the file can not be read
+	bool print_rendered(const char* file) const;
+
 	//! Set the name of the library where the plugin is
 	void set_library_name(const std::string& name) { library_name = name; }
 
 	//! All tests passed by now?
 	bool ok() const { return all_ok; }
+
+	//! timing of the plugin's run() calls in play()
+	const spa::run_stats& timing() const { return run_timing; }
+	//! number of periods in play() where the plugin was idle
+	unsigned skipped_periods() const { return skipped; }
 private:
 	bool all_ok = false;
 	const class spa::descriptor* descriptor = nullptr;
@@ -55,6 +81,8 @@ private:
 
 	bool init_plugin();
 	void shutdown_plugin();
+	//! the input of render(): a 440 Hz sine
+	float sine_at(unsigned long long frame) const;
 
 	using dlopen_handle_t = void*;
 	dlopen_handle_t lib = nullptr;
@@ -62,18 +90,36 @@ private:
 
 	constexpr static int buffersize_fix = 10;
 	unsigned buffersize;
-	std::vector<float> unprocessed_l, unprocessed_r,
+	long samplerate = 48000;
+	unsigned samplecount;
+	spa::audio::block_splitter splitter;
+	spa::audio::aligned_buffer<float> unprocessed_l, unprocessed_r,
 		processed_l, processed_r;
+	//! channel pointer arrays for planar multichannel busses
+	const float* unprocessed_channels[2];
+	float* processed_channels[2];
+	//! where the plugin writes its output, which may be the input
+	//! buffers if it processes in-place
+	const float* result_l = nullptr, * result_r = nullptr;
+	//! hints for the input buffers
+	spa::audio::buffer_flags* input_flags = nullptr;
 
 	// for controls where we do not know the meaning (but the user will)
 	std::vector<float> unknown_controls;
 	std::unique_ptr<spa::audio::osc_ringbuffer> rb;
+	//! the plugin's end of rb, to see if messages are pending
+	const spa::audio::osc_ringbuffer_in* osc_in = nullptr;
+	spa::run_stats run_timing;
+	spa::audio::idle_tracker idle;
+	unsigned skipped = 0;
 
 //	std::map<std::string, port_base*> ports;
 };
 
-osc_host::osc_host(const char* library_name)
+osc_host::osc_host(const char* library_name, unsigned buffersize) :
+	buffersize(buffersize)
 {
+	run_timing.set_samplerate(samplerate);
 	set_library_name(library_name);
 	if(init_plugin())
 		all_ok = true;
@@ -93,25 +139,199 @@ void osc_host::play(int time)
 	if(!plugin)
 		return;
 
-	// simulate automation from the host
-	rb->write("/gain", "f", fmodf(time/10.0f, 1.0f));
+	// the first periods get input and automation, the later ones are
+	// silent, so a plugin with a tail port can be skipped then
+	const bool active = time < active_periods;
 
 	// provide audio input
 	for(unsigned i = 0; i < buffersize; ++i)
 	{
-		unprocessed_l[i] = unprocessed_r[i] = 0.1f;
+		unprocessed_l[i] = unprocessed_r[i] = active ? 0.1f : 0.f;
+	}
+	if(input_flags)
+		input_flags->flags = active ? spa::audio::constant
+			: (spa::audio::constant | spa::audio::silent);
+
+	// simulate automation from the host, sent at the start of the period
+	if(active && rb)
+		rb->write("/gain", "f", fmodf(time/10.0f, 1.0f));
+
+	// skip the plugin while it is idle and nothing can wake it
+	const bool osc_pending = osc_in && osc_in->read_space() > 0;
+	if(idle.need_run(!input_flags || !input_flags->is_silent() ||
+		osc_pending))
+	{
+		// let the plugin work
+		// the block is split in the middle only to demonstrate sample
+		// accurate automation
+		const unsigned splits[] = { buffersize / 2 };
+		spa::audio::denormal_guard guard(
+			!descriptor->properties.needs_subnormals);
+		splitter.run(*plugin, samplecount, buffersize, splits, 1,
+			[](unsigned , unsigned ) {},
+			[&](spa::plugin& plug) {
+				// time each sub-block, without the host code
+				spa::run_timer timer(run_timing, samplecount);
+				// check the promise if libspa-rtcheck.so is
+				// preloaded (only the plugin, not the host)
+				spa::rt_scope rt(descriptor->label(),
+					descriptor->properties.hard_rt_capable);
+				plug.run();
+			});
+		idle.ran();
+	}
+	else
+	{
+		++skipped;
+		// the input is silent, so only the output buffers need to be
+		// cleared, in case the plugin does not work in-place
+		if(idle.first_skip())
+			for(unsigned i = 0; i < buffersize; ++i)
+				processed_l[i] = processed_r[i] = 0.f;
 	}
-
-	// let the plugin work
-	plugin->run();
 
 	// check output
+	const float expected = active ? 0.01f * time : 0.f;
 	for(unsigned i = 0; i < buffersize; ++i)
 	{
 		all_ok = all_ok &&
-			(fabsf(processed_l[i] - 0.01f * time) < 0.0001f) &&
-			(fabsf(processed_r[i] - 0.01f * time) < 0.0001f);
+			(fabsf(result_l[i] - expected) < 0.0001f) &&
+			(fabsf(result_r[i] - expected) < 0.0001f);
+	}
+}
+
+float osc_host::sine_at(unsigned long long frame) const
+{
+	return 0.5f * sinf(static_cast<float>(2.0 * M_PI * 440.0 *
+		static_cast<double>(frame % samplerate) / samplerate));
+}
+
+bool osc_host::print_rendered(const char* file) const
+{
+	std::FILE* f = std::fopen(file, "rb");
+	if(!f)
+		return false;
+	// the WAV header of file_writer is 44 bytes, ending with the data size
+	unsigned long long frames = 0;
+	bool ok = true;
+	if(spa::audio::file_writer::format_of(file) ==
+		spa::audio::file_writer::format_t::wav)
+	{
+		unsigned char header[44];
+		ok = std::fread(header, 1, 44, f) == 44 &&
+			!std::memcmp(header + 36, "data", 4);
+		for(int i = 3; ok && i >= 0; --i)
+			frames = (frames << 8) | header[40 + i];
+		frames /= 2 * sizeof(float);
+	}
+	else
+	{
+		ok = !std::fseek(f, 0, SEEK_END);
+		frames = static_cast<unsigned long long>(std::ftell(f))
+			/ (2 * sizeof(float));
+		std::rewind(f);
+	}
+
+	std::vector<float> samples(2 * frames);
+	ok = ok && std::fread(samples.data(), sizeof(float), samples.size(),
+		f) == samples.size();
+	std::fclose(f);
+	if(!ok)
+		return false;
+	std::cout << "file has " << frames << " frames" << std::endl;
+
+	// a change happens after the last frame with the old gain, frames
+	// where the input is (almost) zero do not tell the gain
+	float gain = -1.f;
+	unsigned long long last_measured = 0;
+	for(unsigned long long i = 0; i < frames; ++i)
+	{
+		const float in = sine_at(i);
+		if(fabsf(in) < 0.01f)
+			continue;
+		const float measured =
+			roundf(samples[2 * i] / in * 10000.f) / 10000.f;
+		if(measured != gain)
+		{
+			std::cout << "gain " << measured << " from frame "
+				<< (gain < 0.f ? 0 : last_measured + 1)
+				<< std::endl;
+			gain = measured;
+		}
+		last_measured = i;
+	}
+	return true;
+}
+
+bool osc_host::render(const char* outfile, unsigned long long frames,
+	const char* automation_file)
+{
+	if(!plugin)
+		return false;
+	if(descriptor->properties.realtime_dependency)
+	{
+		// its output depends on the time when it is being run
+		std::cerr << "plugin has a realtime dependency, refusing to "
+			"render it offline" << std::endl;
+		return false;
+	}
+
+	spa::audio::automation automation;
+	if(automation_file)
+	{
+		automation.load(automation_file);
+		if(!rb && automation.size())
+			std::cerr << "Warning: plugin has no OSC port, "
+				"ignoring automation" << std::endl;
 	}
+
+	spa::audio::file_writer writer(outfile,
+		spa::audio::file_writer::format_of(outfile), 2,
+		static_cast<unsigned long>(samplerate));
+	std::vector<unsigned> splits;
+	unsigned long long pos = 0;
+	const float* result[2];
+
+	using clock = std::chrono::steady_clock;
+	const clock::time_point start = clock::now();
+	while(pos < frames)
+	{
+		const unsigned period = static_cast<unsigned>(
+			std::min<unsigned long long>(buffersize, frames - pos));
+
+		// provide audio input
+		for(unsigned i = 0; i < period; ++i)
+			unprocessed_l[i] = unprocessed_r[i] = sine_at(pos + i);
+		if(input_flags)
+			input_flags->flags = 0;
+
+		// split the period where automation is due
+		splits.clear();
+		automation.splits(pos, period, splits);
+		spa::audio::denormal_guard guard(
+			!descriptor->properties.needs_subnormals);
+		splitter.run(*plugin, samplecount, period, splits.data(),
+			splits.size(), [&](unsigned first_frame, unsigned n) {
+				if(rb)
+					automation.send(*rb,
+						pos + first_frame + n);
+			});
+
+		result[0] = result_l;
+		result[1] = result_r;
+		writer.write(result, period);
+		pos += period;
+	}
+	const bool written = writer.close();
+	const std::chrono::duration<double> elapsed = clock::now() - start;
+
+	std::cout << "rendered " << frames << " frames in " << elapsed.count()
+		<< " s (" << (frames / static_cast<double>(samplerate))
+			/ elapsed.count()
+		<< " x realtime)" << std::endl;
+	if(!written)
+		std::cerr << "Error writing " << outfile << std::endl;
+	return written;
 }
 
 struct host_visitor : public virtual spa::audio::visitor
@@ -120,28 +340,111 @@ struct host_visitor : public virtual spa::audio::visitor
 	osc_host* h;
 	using spa::audio::visitor::visit;
 
+	//! all our buffers have the same alignment and padding
+	void check_buffer(const spa::audio::buffer_port& p) {
+		if(!h->unprocessed_l.fulfills(p))
+			ok = false;
+	}
+
 	// TODO: forbid channel.operator= x ? (use channel class with set method)
 	virtual void visit(spa::audio::in& p) override {
 		printf("in, c: %d\n", p.channel);
+		check_buffer(p);
 		p.set_ref((p.channel == spa::audio::stereo::left)
 			? h->unprocessed_l.data()
-			: h->unprocessed_r.data()); }
+			: h->unprocessed_r.data());
+		h->splitter.add(p); }
 	virtual void visit(spa::audio::out& p) override {
 		printf("out, c: %d\n", p.channel);
-		p.set_ref((p.channel == spa::audio::stereo::left)
-			? h->processed_l.data()
-			: h->processed_r.data()); }
+		check_buffer(p);
+		if(!spa::audio::connect_in_place(p))
+			p.set_ref((p.channel == spa::audio::stereo::left)
+				? h->processed_l.data()
+				: h->processed_r.data());
+		((p.channel == spa::audio::stereo::left)
+			? h->result_l : h->result_r) = p.get_ref();
+		h->splitter.add(p); }
+	virtual void visit(spa::audio::flat::in& p) override {
+		printf("in, flat, c: %d\n", p.target->channel);
+		check_buffer(p);
+		p.connect((p.target->channel == spa::audio::stereo::left)
+			? h->unprocessed_l.data()
+			: h->unprocessed_r.data());
+		h->splitter.add(p); }
+	virtual void visit(spa::audio::flat::out& p) override {
+		printf("out, flat, c: %d\n", p.target->channel);
+		check_buffer(p);
+		const bool left = p.target->channel == spa::audio::stereo::left;
+		if(!spa::audio::connect_in_place(p))
+			p.connect(left ? h->processed_l.data()
+				: h->processed_r.data());
+		(left ? h->result_l : h->result_r) = p.target->data;
+		h->splitter.add(p); }
 	virtual void visit(spa::audio::stereo::in& p) override {
 		std::cout << "in, stereo" << std::endl;
+		check_buffer(p);
+		h->input_flags = &p;
 		p.left = h->unprocessed_l.data();
-		p.right = h->unprocessed_r.data(); }
+		p.right = h->unprocessed_r.data();
+		h->splitter.add(p); }
 	virtual void visit(spa::audio::stereo::out& p) override {
 		std::cout << "out, stereo" << std::endl;
-		p.left = h->processed_l.data();
-		p.right = h->processed_r.data(); }
+		check_buffer(p);
+		if(spa::audio::connect_in_place(p))
+			std::cout << "  (in-place)" << std::endl;
+		else {
+			p.left = h->processed_l.data();
+			p.right = h->processed_r.data();
+		}
+		h->result_l = p.left;
+		h->result_r = p.right;
+		h->splitter.add(p); }
+	virtual void visit(spa::audio::bus::in& p) override {
+		std::cout << "in, bus" << std::endl;
+		check_buffer(p);
+		h->input_flags = &p;
+		if(p.channels != 2 || !(p.layouts & spa::audio::bus::planar))
+			ok = false;
+		else {
+			h->unprocessed_channels[0] = h->unprocessed_l.data();
+			h->unprocessed_channels[1] = h->unprocessed_r.data();
+			p.connect_planar(h->unprocessed_channels);
+			h->splitter.add(h->unprocessed_channels[0]);
+			h->splitter.add(h->unprocessed_channels[1]);
+			h->splitter.align_to(p);
+		} }
+	virtual void visit(spa::audio::bus::out& p) override {
+		std::cout << "out, bus" << std::endl;
+		check_buffer(p);
+		if(p.channels != 2 || !(p.layouts & spa::audio::bus::planar))
+			ok = false;
+		else {
+			if(!spa::audio::connect_in_place(p)) {
+				h->processed_channels[0] =
+					h->processed_l.data();
+				h->processed_channels[1] =
+					h->processed_r.data();
+				p.connect_planar(h->processed_channels);
+				h->splitter.add(h->processed_channels[0]);
+				h->splitter.add(h->processed_channels[1]);
+				h->splitter.align_to(p);
+			}
+			h->result_l = p.channel(0);
+			h->result_r = p.channel(1);
+		} }
 	virtual void visit(spa::audio::buffersize& p) override {
 		std::cout << "buffersize" << std::endl;
 		p.set_ref(&h->buffersize); }
+	virtual void visit(spa::audio::samplerate& p) override {
+		std::cout << "samplerate" << std::endl;
+		p.set_ref(&h->samplerate); }
+	virtual void visit(spa::audio::samplecount& p) override {
+		std::cout << "samplecount" << std::endl;
+		p.set_ref(&h->samplecount);
+		h->splitter.add(p); }
+	virtual void visit(spa::audio::tail& p) override {
+		std::cout << "tail" << std::endl;
+		h->idle.connect(p); }
 	virtual void visit(spa::audio::osc_ringbuffer_in& p) override {
 		std::cout << "ringbuffer input" << std::endl;
 		if(h->rb)
@@ -150,6 +453,7 @@ struct host_visitor : public virtual spa::audio::visitor
 			h->rb.reset(
 				new spa::audio::osc_ringbuffer(p.get_size()));
 			p.connect(*h->rb);
+			h->osc_in = &p;
 		}
 	}
 
@@ -204,7 +508,6 @@ bool osc_host::init_plugin()
 	}
 
 	// initialize all our port names before connecting...
-	buffersize = buffersize_fix;
 	// ... especially the buffers...
 	unprocessed_l.resize(buffersize);
 	unprocessed_r.resize(buffersize);
@@ -212,8 +515,30 @@ bool osc_host::init_plugin()
 	processed_r.resize(buffersize);
 
 
-	const spa::simple_vec<spa::simple_str> port_names =
-		descriptor->port_names();
+	// fast path: connect the ports by index, without any string
+	// comparisons or exceptions
+	const char* const* port_table = descriptor->port_table();
+	for(unsigned i = 0; port_table && port_table[i]; ++i)
+	{
+		std::cout << "port #" << i << ": " << port_table[i]
+			  << std::endl;
+		spa::port_ref_base* port_ref = plugin->port_at(i);
+		host_visitor v;
+		v.h = this;
+		if(port_ref)
+			port_ref->accept(v);
+		if(!port_ref || !v.ok) {
+			std::cerr << "plugin specifies invalid port \""
+				<< port_table[i] << "\", but does not provide it"
+				<< std::endl;
+			return false;
+		}
+	}
+
+	// slow path: connect the ports by name
+	const spa::simple_vec<spa::simple_str> port_names = port_table
+		? spa::simple_vec<spa::simple_str>()
+		: descriptor->port_names();
 
 	for(const spa::simple_str& port_name : port_names)
 	{
@@ -276,7 +601,14 @@ void osc_host::shutdown_plugin()
 
 void usage()
 {
-	std::cout << "usage: osc-host [<shared object library>]\n" << std::endl;
+	std::cout << "usage: osc-host [<shared object library>\n"
+		"                [render <outfile> <frames> [<automation>]]]\n"
+		"  render: render offline, as fast as possible, into a wav file"
+		" (if <outfile>\n"
+		"          ends in .wav) or a raw float file. <automation>"
+		" contains lines\n"
+		"          \"<frame> <OSC path> <types> <args...>\"\n"
+		<< std::endl;
 	exit(0);
 }
 
@@ -284,6 +616,15 @@ int main(int argc, char** argv)
 {
 	int rc = EXIT_SUCCESS;
 	const char* library_name = nullptr;
+	const char* render_file = nullptr, * automation_file = nullptr;
+	unsigned long long render_frames = 0;
+	if(argc >= 5 && !strcmp(argv[2], "render"))
+	{
+		render_file = argv[3];
+		render_frames = std::strtoull(argv[4], nullptr, 10);
+		automation_file = (argc >= 6) ? argv[5] : nullptr;
+		argc = 2;
+	}
 	switch(argc)
 	{
 		case 1:
@@ -304,12 +645,36 @@ int main(int argc, char** argv)
 		if(realpath(library_name, abs_path))
 		{
 			library_name = abs_path;
-			osc_host host(library_name);
-			for(int i = 0; i < 10; ++i)
-				host.play(i);
-			if(!host.ok())
-				throw std::runtime_error("Error while starting"
-							" or running the host");
+			if(render_file)
+			{
+				// large blocks for fewer calls
+				osc_host host(library_name, 4096);
+				if(!host.ok() || !host.render(render_file,
+					render_frames, automation_file) ||
+					!host.print_rendered(render_file))
+					throw std::runtime_error("Error while "
+						"rendering");
+			}
+			else
+			{
+				osc_host host(library_name);
+				// 5 silent periods at the end
+				for(int i = 0; i < osc_host::active_periods + 5;
+					++i)
+					host.play(i);
+				const spa::run_stats::totals t =
+					host.timing().read();
+				std::cout << "run(): " << t.calls
+					<< " calls, mean load " << t.load()
+					<< " %, peak load " << t.peak_load()
+					<< " %" << std::endl;
+				std::cout << "skipped "
+					<< host.skipped_periods()
+					<< " idle periods" << std::endl;
+				if(!host.ok())
+					throw std::runtime_error("Error while "
+						"starting or running the host");
+			}
 		}
 		else {
 			perror("Getting absolute path of plugin");
@@ -25,9 +25,9 @@
 
 #include <cstring>
 #include <iostream>
-#include <vector>
 
 #include <spa/audio.h>
+#include <spa/port_list.h>
 
 class example_plugin : public spa::plugin
 {
@@ -37,8 +37,6 @@ class example_plugin : public spa::plugin
 		int some_extra_value;
 		buffersize_port() : some_extra_value(0) {}
 	};
-	//! useless buffer, just for demonstration
-	std::vector<float> out_buffer_l, out_buffer_r;
 
 public:
 	void run() override
@@ -57,48 +55,79 @@ public:
 			}
 		}
 
-		for(unsigned i = 0; i < buffersize; ++i)
+		// a gain has no memory, so without input, its output is silent
+		if(tail.get_ref())
+			tail = 0;
+
+		// silence and constant signals stay so after applying the gain
+		out.flags = in.flags &
+			(spa::audio::silent | spa::audio::constant);
+		if(in.is_silent() && out.left == in.left &&
+			out.right == in.right)
+			return; // in-place: the buffers contain zeros already
+
+		// the host may run us on only a part of the buffers
+		const unsigned frames = samplecount.get_ref()
+			? static_cast<unsigned>(samplecount)
+			: static_cast<unsigned>(buffersize);
+
+		// each sample is read before it is written, so this also works
+		// if the host connects in and out to the same buffers
+		for(unsigned i = 0; i < frames; ++i)
 		{
-			out_buffer_l[i] = gain * in.left[i];
-			out_buffer_r[i] = gain * in.right[i];
+			out.left[i] = gain * in.left[i];
+			out.right[i] = gain * in.right[i];
 		}
-
-		memcpy(out.left, out_buffer_l.data(), buffersize * sizeof(out.left[0]));
-		memcpy(out.right, out_buffer_r.data(), buffersize * sizeof(out.right[0]));
-	}
-
-	void init() override {
-		out_buffer_l.resize(buffersize);
-		out_buffer_r.resize(buffersize);
 	}
 
 public:	// FEATURE: make these private?
 	virtual ~example_plugin() {}
-	example_plugin() : osc_in(1024) {}
+	example_plugin() : osc_in(1024) { out.in_place = &in; }
 
 private:
 
 	void activate() override {}
 	void deactivate() override {}
 
+	//! the only state that is not in the ports is the gain
+	std::size_t snapshot_save(void* buffer, std::size_t size) override {
+		if(size >= sizeof(gain))
+			std::memcpy(buffer, &gain, sizeof(gain));
+		return sizeof(gain);
+	}
+	bool snapshot_load(const void* buffer, std::size_t size) override {
+		if(size != sizeof(gain))
+			return false;
+		std::memcpy(&gain, buffer, sizeof(gain));
+		return true;
+	}
+
 	float gain = 0.0f; // received via OSC
 
 	spa::audio::stereo::in in;
 	spa::audio::stereo::out out;
 	buffersize_port buffersize;
+	spa::audio::samplecount samplecount;
 	spa::audio::osc_ringbuffer_in osc_in;
+	spa::audio::tail tail;
 
-	spa::port_ref_base& port(const char* path) override
-	{
-		using p = spa::port_ref_base;
-		switch(path[0])
-		{
-			case 'i': return in;
-			case 'o': return path[1] == 's' ? (p&)osc_in : (p&)out;
-			case 'b': return buffersize;
-			default: throw spa::port_not_found(path);
-		}
-	}
+	SPA_PORT(in);
+	SPA_PORT(out);
+	SPA_PORT(buffersize);
+	SPA_PORT_NAMED(osc, osc_in);
+	SPA_PORT(samplecount);
+	SPA_PORT(tail);
+
+public:
+	//! the port names and lookup are computed at compile time
+	using ports = spa::port_list<example_plugin, port_in, port_out,
+		port_buffersize, port_osc, port_samplecount, port_tail>;
+
+private:
+	spa::port_ref_base& port(const char* path) override {
+		return ports::port(*this, path); }
+	spa::port_ref_base* port_at(unsigned index) override {
+		return ports::port_at(*this, index); }
 };
 
 class example_descriptor : public spa::descriptor
@@ -124,10 +153,11 @@ public:
 
 	license_type license() const override { return license_type::gpl_3_0; }
 
-	struct port_names_t { const char** names; };
 	spa::simple_vec<spa::simple_str> port_names() const override {
-		return { "in", "out", "buffersize", "osc" };
-	}
+		return example_plugin::ports::port_names(); }
+	const char* const* port_table() const override {
+		return example_plugin::ports::port_table(); }
+	bool snapshot_has() const override { return true; }
 
 	example_plugin* instantiate() const override {
 		return new example_plugin; }
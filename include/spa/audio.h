@@ -35,6 +35,9 @@
 #ifndef SPA_AUDIO_H
 #define SPA_AUDIO_H
 
+#include <cstdint>
+#include <limits>
+
 #include <rtosc/pseudo-rtosc.h>
 
 #include "spa.h"
@@ -62,48 +65,292 @@ public:
 	port types
 */
 
+//! base class for ports that reference audio buffers
+//! The plugin can declare requirements for the buffer memory, which the host
+//! must fulfill when connecting the port (e.g. for aligned SIMD loads).
+//!
+//! Output ports have a member @a in_place. If the plugin sets it to one of
+//! its input ports of the same type, it can process in-place, i.e. the host
+//! may connect the output to the same buffers as that input (see
+//! connect_in_place()).
+class buffer_port
+{
+public:
+	//! required alignment of each buffer in bytes, must be a power of 2
+	unsigned alignment = alignof(float);
+	//! the allocated size of each buffer in bytes must be rounded up to a
+	//! multiple of this, i.e. the plugin may process whole blocks of this
+	//! size, even past the buffer's end. Must be a power of 2
+	unsigned padding = sizeof(float);
+
+	//! require buffers suited for SIMD registers of @p bytes width,
+	//! e.g. 32 for AVX, such that no scalar tail loops are required
+	void require_simd(unsigned bytes) { alignment = padding = bytes; }
+};
+
+//! hints about the contents of an audio buffer in the current block
+//! The values can be or'ed
+enum buffer_flag_t {
+	//! all samples are zero (implies constant)
+	silent = 1,
+	//! all samples are equal to the first one
+	constant = 2,
+	//! the contents equal the contents in the previous block
+	unchanged = 4
+};
+
+//! base class for ports that carry buffer_flag_t hints, which allow to skip
+//! work, e.g. for idle tracks
+//! For input ports, the host sets the flags before each plugin::run(). For
+//! output ports, the plugin sets them in each plugin::run(), so downstream
+//! plugins can skip work, too. For ports with multiple buffers (stereo, bus),
+//! a flag means that it applies to each buffer.
+class buffer_flags
+{
+public:
+	//! combination of buffer_flag_t, 0 if nothing is known
+	int flags = 0;
+
+	bool is_silent() const { return flags & silent; }
+	bool is_constant() const { return flags & (silent | constant); }
+	bool is_unchanged() const { return flags & unchanged; }
+};
+
 namespace stereo {
 
 	//! enum for the case of two separate ports per stereo signal
 	enum { left, right };
 
 	//! audio signal input
-	class in : public port_ref_base
+	class in : public port_ref_base, public buffer_port,
+		public buffer_flags
 	{
 	public:
 		SPA_OBJECT
 
-		const float* left;
-		const float* right;
+		const float* left = nullptr;
+		const float* right = nullptr;
 
 		int directions() const override { return direction_t::input; }
 	};
 
 	//! audio signal output
-	class out : public port_ref_base
+	class out : public port_ref_base, public buffer_port,
+		public buffer_flags
 	{
 	public:
 		SPA_OBJECT
 
-		float* left;
-		float* right;
+		float* left = nullptr;
+		float* right = nullptr;
+
+		const in* in_place = nullptr; //!< see buffer_port
 
 		int directions() const override { return direction_t::output; }
 	};
 } // namespace stereo
 
+namespace bus {
+
+	//! memory layout of the channels of a multichannel bus
+	//! the values can be or'ed to express multiple supported layouts
+	enum layout_t {
+		//! one buffer per channel
+		planar = 1,
+		//! one buffer, with the samples of one frame being adjacent
+		interleaved = 2
+	};
+
+	//! base class for multichannel busses, don't use directly
+	template<class T>
+	class bus_base : public port_ref_base, public buffer_port,
+		public buffer_flags
+	{
+		T* const* planar_data = nullptr;
+		T* interleaved_data = nullptr;
+		layout_t used_layout = planar;
+	public:
+		//! number of channels, must be set by the plugin
+		unsigned channels = 0;
+		//! combination of layout_t, must be set by the plugin to
+		//! all layouts it can handle
+		int layouts = planar;
+
+		//! layout that the host has chosen when connecting
+		layout_t layout() const { return used_layout; }
+
+		//! connect @a channels buffers, one for each channel
+		//! @param data array of @a channels pointers, must be valid
+		//!   as long as the port is connected
+		void connect_planar(T* const* data) noexcept(false)
+		{
+			if(!(layouts & planar))
+				throw exception("bus does not support planar "
+					"layout");
+			used_layout = planar;
+			planar_data = data;
+		}
+
+		//! connect one buffer of size @a channels * buffersize
+		void connect_interleaved(T* data) noexcept(false)
+		{
+			if(!(layouts & interleaved))
+				throw exception("bus does not support "
+					"interleaved layout");
+			used_layout = interleaved;
+			interleaved_data = data;
+		}
+
+		//! return the buffer of channel @p c (planar layout only)
+		T* channel(unsigned c) const { return planar_data[c]; }
+		//! return the array of channel buffers (planar layout only)
+		T* const* planar_buffers() const { return planar_data; }
+		//! return the interleaved buffer (interleaved layout only)
+		T* interleaved_buffer() const { return interleaved_data; }
+
+		//! return sample @p frame of channel @p c, for any layout
+		//! @note prefer channel() or interleaved_buffer() in loops
+		T& at(unsigned frame, unsigned c) const {
+			return (used_layout == planar)
+				? planar_data[c][frame]
+				: interleaved_data[frame * channels + c];
+		}
+	};
+
+	//! multichannel audio signal input
+	class in : public bus_base<const float>
+	{
+	public:
+		SPA_OBJECT
+		int directions() const override { return direction_t::input; }
+	};
+
+	//! multichannel audio signal output
+	class out : public bus_base<float>
+	{
+	public:
+		SPA_OBJECT
+		const in* in_place = nullptr; //!< see buffer_port
+
+		int directions() const override {
+			return direction_t::output; }
+	};
+} // namespace bus
+
 //! audio signal input
 class in : public virtual port_ref<const float>, public virtual counted,
-	public virtual input
+	public virtual input, public buffer_port, public buffer_flags
 {
 	SPA_OBJECT
 };
 
 //! audio signal input
 class out : public port_ref<float>, public virtual counted,
-	public virtual output
+	public virtual output, public buffer_port, public buffer_flags
 {
 	SPA_OBJECT
+public:
+	const in* in_place = nullptr; //!< see buffer_port
+};
+
+namespace flat {
+
+	//! Hot path data of an audio port, which the plugin reads directly
+	//! in run(), without any virtual base offsets. The plugin can keep
+	//! these structs together (e.g. in an array), the host fills them
+	//! when connecting the corresponding flat::in or flat::out port.
+	template<class T>
+	struct alignas(16) buffer
+	{
+		T* data = nullptr; //!< the samples, set by the host
+		int flags = 0;     //!< combination of buffer_flag_t
+		int channel = 0;   //!< e.g. stereo::left, set by the plugin
+	};
+
+	//! connection-time port for a buffer, don't use directly
+	//! Only this object is visited. As it is not used in run(), the
+	//! plugin can store it apart from the hot data.
+	template<class T>
+	class port_base : public port_ref_base, public buffer_port
+	{
+	public:
+		buffer<T>* const target;
+		explicit port_base(buffer<T>& target) : target(&target) {}
+		void connect(T* data) { target->data = data; }
+	};
+
+	//! audio signal input, see buffer
+	class in : public port_base<const float>
+	{
+	public:
+		SPA_OBJECT
+		using port_base::port_base;
+		int directions() const override { return direction_t::input; }
+	};
+
+	//! audio signal output, see buffer
+	class out : public port_base<float>
+	{
+	public:
+		SPA_OBJECT
+		using port_base::port_base;
+		const in* in_place = nullptr; //!< see buffer_port
+		int directions() const override {
+			return direction_t::output; }
+	};
+} // namespace flat
+
+//! 24 bit signed PCM sample, stored sign extended in 32 bits
+struct int24
+{
+	int32_t value;
+};
+
+//! sample formats for pcm_in and pcm_out
+enum class sample_format_t
+{
+	f32, //!< float
+	f64, //!< double
+	s16, //!< int16_t
+	s24, //!< int24
+	s32  //!< int32_t
+};
+
+//! sample_format<T>::value is the sample_format_t for sample type @p T
+template<class T> struct sample_format;
+template<> struct sample_format<float> {
+	static constexpr sample_format_t value = sample_format_t::f32; };
+template<> struct sample_format<double> {
+	static constexpr sample_format_t value = sample_format_t::f64; };
+template<> struct sample_format<int16_t> {
+	static constexpr sample_format_t value = sample_format_t::s16; };
+template<> struct sample_format<int24> {
+	static constexpr sample_format_t value = sample_format_t::s24; };
+template<> struct sample_format<int32_t> {
+	static constexpr sample_format_t value = sample_format_t::s32; };
+
+//! audio signal input with samples of type @p T, being one of double,
+//! int16_t, int24 or int32_t (for float, use in)
+//! The host can connect buffers of other formats using the conversion
+//! functions from audio_convert.h
+template<class T>
+class pcm_in : public virtual port_ref<const T>, public virtual counted,
+	public virtual input, public buffer_port, public buffer_flags
+{
+public:
+	SPA_OBJECT
+	static constexpr sample_format_t format = sample_format<T>::value;
+};
+
+//! audio signal output with samples of type @p T, see pcm_in
+template<class T>
+class pcm_out : public virtual port_ref<T>, public virtual counted,
+	public virtual output, public buffer_port, public buffer_flags
+{
+public:
+	SPA_OBJECT
+	static constexpr sample_format_t format = sample_format<T>::value;
+	const pcm_in<T>* in_place = nullptr; //!< see buffer_port
 };
 
 enum class scale_type_t
@@ -160,6 +407,90 @@ class samplecount : public virtual control_in<unsigned> {
 	bool compulsory() const override { return false; }
 };
 
+//! value of a tail port for plugins that must always be run
+constexpr const unsigned tail_infinite = std::numeric_limits<unsigned>::max();
+
+//! Informs the host for how many frames after the current block the output
+//! may still be non-silent if no new input arrives, e.g. the rest of a
+//! reverb tail. The plugin sets it in each plugin::run(), the host sets it
+//! to tail_infinite before.
+//! 0 means that the plugin is idle: its output stays silent until new input
+//! (non-silent audio, events or OSC messages) arrives, so the host may stop
+//! calling plugin::run() until then (see idle_tracker).
+class tail : public virtual control_out<unsigned> {
+	SPA_OBJECT
+	bool compulsory() const override { return false; }
+	int directions() const override { return direction_t::output; }
+public:
+	using port_ref<unsigned>::operator=;
+};
+
+//! type of an event
+enum class event_type : uint8_t
+{
+	note_on,        //!< key, velocity
+	note_off,       //!< key, velocity (release velocity)
+	controller,     //!< key = controller number, value
+	pitch_bend,     //!< 14 bit value: key (lower 7 bits), value (upper 7)
+	program_change  //!< value = program number
+};
+
+//! compact binary event, e.g. for notes, as an alternative for OSC messages
+//! in high event rates
+struct event
+{
+	uint32_t frame;   //!< offset in the current block, in samples
+	event_type type;
+	uint8_t channel;  //!< e.g. MIDI channel
+	uint8_t key;      //!< key (0..127, 69 is 440 Hz) or controller number
+	uint8_t value;    //!< velocity or controller value (0..127)
+};
+
+//! input of events for the current block
+//! The host sets the events before each plugin::run()
+class event_in : public port_ref_base
+{
+public:
+	SPA_OBJECT
+
+	//! array of @a count events, sorted by event::frame
+	const event* events = nullptr;
+	unsigned count = 0;
+
+	const event* begin() const { return events; }
+	const event* end() const { return events + count; }
+
+	int directions() const override { return direction_t::input; }
+};
+
+//! output of events for the current block
+//! The host provides the array and resets @a count to 0 before each
+//! plugin::run(), the plugin adds events sorted by event::frame
+class event_out : public port_ref_base
+{
+public:
+	SPA_OBJECT
+
+	event* events = nullptr;
+	unsigned capacity = 0;
+	unsigned count = 0;
+
+	//! append @p ev, if there is space left
+	//! @return true iff there was space left
+	bool push(const event& ev)
+	{
+		if(count < capacity)
+		{
+			events[count++] = ev;
+			return true;
+		}
+		else
+			return false;
+	}
+
+	int directions() const override { return direction_t::output; }
+};
+
 //! ringbuffer instance for the host
 class osc_ringbuffer : public ringbuffer<char>
 {
@@ -240,6 +571,7 @@ public:
 class visitor : public virtual spa::visitor
 {
 public:
+	SPA_VISITOR(1, spa::visitor)
 	using spa::visitor::visit;
 
 #define SPA_MK_VISIT_AUDIO(type) \
@@ -264,15 +596,34 @@ public:
 
 	SPA_MK_VISIT(audio::stereo::in, port_ref_base)
 	SPA_MK_VISIT(audio::stereo::out, port_ref_base)
+	SPA_MK_VISIT(audio::bus::in, port_ref_base)
+	SPA_MK_VISIT(audio::bus::out, port_ref_base)
+	SPA_MK_VISIT(audio::flat::in, port_ref_base)
+	SPA_MK_VISIT(audio::flat::out, port_ref_base)
 
 	SPA_MK_VISIT(osc_ringbuffer_in, ringbuffer_in<char>)
 	SPA_MK_VISIT(osc_ringbuffer_out, ringbuffer_out<char>)
+	SPA_MK_VISIT(event_in, port_ref_base)
+	SPA_MK_VISIT(event_out, port_ref_base)
 
 	SPA_MK_VISIT(in, port_ref<const float>)
 	SPA_MK_VISIT(out, port_ref<float>)
+
+#define SPA_MK_VISIT_PCM(type, base_in, base_out) \
+	SPA_MK_VISIT(pcm_in<type>, base_in) \
+	SPA_MK_VISIT(pcm_out<type>, base_out)
+
+	SPA_MK_VISIT_PCM(double, port_ref<const double>, port_ref<double>)
+	SPA_MK_VISIT_PCM(int16_t, port_ref<const int16_t>, port_ref<int16_t>)
+	SPA_MK_VISIT_PCM(int24, port_ref_base, port_ref_base)
+	SPA_MK_VISIT_PCM(int32_t, port_ref<const int32_t>, port_ref<int32_t>)
+
+#undef SPA_MK_VISIT_PCM
+
 	SPA_MK_VISIT(samplerate, control_in<long>)
 	SPA_MK_VISIT(buffersize, control_in<unsigned>)
 	SPA_MK_VISIT(samplecount, control_in<unsigned>)
+	SPA_MK_VISIT(tail, control_out<unsigned>)
 
 	virtual ~visitor();
 };
@@ -284,6 +635,8 @@ public:
 
 ACCEPT_SPA_AUDIO_T(control_in)
 ACCEPT_SPA_AUDIO_T(control_out)
+ACCEPT_SPA_AUDIO_T(pcm_in)
+ACCEPT_SPA_AUDIO_T(pcm_out)
 
 #undef ACCEPT_SPA_AUDIO_T
 
@@ -0,0 +1,258 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file audio_convert.h
+	conversion between the sample formats of spa::audio::sample_format_t
+
+	The loops are written such that compilers can vectorize them (e.g. gcc
+	and clang with -O3). Gain is applied in the same pass, so a host needs
+	only one pass to connect ports of different formats. Integers are
+	scaled by 2^(bits-1) in both directions.
+*/
+
+#ifndef SPA_AUDIO_CONVERT_H
+#define SPA_AUDIO_CONVERT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "audio.h"
+
+namespace spa {
+namespace audio {
+
+namespace detail {
+
+//! conversion of one sample type from and to its real value in [-1, 1]
+//! @p R is the real type used for computations
+template<class T, class R> struct sample_traits;
+
+template<class R> struct sample_traits<float, R>
+{
+	static R to_real(float s) { return s; }
+	static float from_real(R r) { return static_cast<float>(r); }
+};
+
+template<class R> struct sample_traits<double, R>
+{
+	static R to_real(double s) { return static_cast<R>(s); }
+	static double from_real(R r) { return r; }
+};
+
+//! integer formats with @p Bits bits, stored in @p I
+//! Decoding divides by 2^(Bits-1), so the smallest sample is exactly -1, and
+//! encoding multiplies by the same value and clamps to the largest sample.
+template<class I, class R, int Bits> struct int_sample_traits
+{
+	static constexpr R scale() { return R(1LL << (Bits - 1)); }
+	static R to_real(I s) { return static_cast<R>(s) * (R(1) / scale()); }
+	static I from_real(R r)
+	{
+		// round half away from zero, then clamp; copysign becomes bit
+		// operations and std::min/std::max become minps/maxps, so the
+		// loops have no control flow and vectorize (check with gcc's
+		// -fopt-info-vec)
+		R x = r * scale();
+		x += std::copysign(R(0.5), x);
+		x = std::min(std::max(x, -scale()), scale() - R(1));
+		return static_cast<I>(x);
+	}
+};
+
+template<class R> struct sample_traits<int16_t, R> :
+	public int_sample_traits<int16_t, R, 16> {};
+template<class R> struct sample_traits<int32_t, R> :
+	public int_sample_traits<int32_t, R, 32> {};
+
+template<class R> struct sample_traits<int24, R>
+{
+	using base = int_sample_traits<int32_t, R, 24>;
+	static R to_real(int24 s) { return base::to_real(s.value); }
+	static int24 from_real(R r) { return int24 { base::from_real(r) }; }
+};
+
+//! type for computations: double if any of @p S and @p D is double or a
+//! 32 bit integer (which float can not represent exactly), else float
+template<class S, class D> struct real_type { using type = float; };
+template<class D> struct real_type<double, D> { using type = double; };
+template<class D> struct real_type<int32_t, D> { using type = double; };
+template<class S> struct real_type<S, double> { using type = double; };
+template<class S> struct real_type<S, int32_t> { using type = double; };
+template<> struct real_type<double, double> { using type = double; };
+template<> struct real_type<double, int32_t> { using type = double; };
+template<> struct real_type<int32_t, double> { using type = double; };
+template<> struct real_type<int32_t, int32_t> { using type = double; };
+
+}
+
+//! convert @p size samples from @p src to @p dst, multiplying by @p gain
+//! Integer formats are clamped. @p src and @p dst must not overlap.
+template<class S, class D>
+void convert(const S* __restrict__ src, D* __restrict__ dst,
+	std::size_t size, float gain = 1.0f)
+{
+	using R = typename detail::real_type<S, D>::type;
+	using src_traits = detail::sample_traits<S, R>;
+	using dst_traits = detail::sample_traits<D, R>;
+	const R g = gain;
+	for(std::size_t i = 0; i < size; ++i)
+		dst[i] = dst_traits::from_real(src_traits::to_real(src[i]) * g);
+}
+
+//! like convert(), but adds the converted samples to @p dst, e.g. to mix
+//! multiple outputs into one input. @p src and @p dst must not overlap.
+template<class S, class D>
+void convert_add(const S* __restrict__ src, D* __restrict__ dst,
+	std::size_t size, float gain = 1.0f)
+{
+	using R = typename detail::real_type<S, D>::type;
+	using src_traits = detail::sample_traits<S, R>;
+	using dst_traits = detail::sample_traits<D, R>;
+	const R g = gain;
+	for(std::size_t i = 0; i < size; ++i)
+		dst[i] = dst_traits::from_real(dst_traits::to_real(dst[i]) +
+			src_traits::to_real(src[i]) * g);
+}
+
+/*
+	format negotiation
+*/
+
+//! Finds the sample format of the audio ports it visits
+//! Hosts negotiate the format per port: if the port has the format of the
+//! host's buffers, they are connected directly, otherwise the host keeps
+//! one buffer in the port's format and converts once per block, fused
+//! with the gain (see convert()). The plugin never needs a scratch copy.
+class format_visitor : public virtual visitor
+{
+public:
+	bool found = false;
+	sample_format_t format = sample_format_t::f32;
+
+	using visitor::visit;
+	void visit(in& ) override { set(sample_format_t::f32); }
+	void visit(out& ) override { set(sample_format_t::f32); }
+	void visit(stereo::in& ) override { set(sample_format_t::f32); }
+	void visit(stereo::out& ) override { set(sample_format_t::f32); }
+	void visit(bus::in& ) override { set(sample_format_t::f32); }
+	void visit(bus::out& ) override { set(sample_format_t::f32); }
+	void visit(flat::in& ) override { set(sample_format_t::f32); }
+	void visit(flat::out& ) override { set(sample_format_t::f32); }
+	void visit(pcm_in<double>& p) override { set(p.format); }
+	void visit(pcm_out<double>& p) override { set(p.format); }
+	void visit(pcm_in<int16_t>& p) override { set(p.format); }
+	void visit(pcm_out<int16_t>& p) override { set(p.format); }
+	void visit(pcm_in<int24>& p) override { set(p.format); }
+	void visit(pcm_out<int24>& p) override { set(p.format); }
+	void visit(pcm_in<int32_t>& p) override { set(p.format); }
+	void visit(pcm_out<int32_t>& p) override { set(p.format); }
+private:
+	void set(sample_format_t f) { found = true; format = f; }
+};
+
+//! find the sample format of port @p p
+//! @return false if @p p is no audio port
+inline bool sample_format_of(port_ref_base& p, sample_format_t& format)
+{
+	format_visitor v;
+	p.accept(v);
+	format = v.format;
+	return v.found;
+}
+
+//! size of one sample of format @p f, in bytes
+inline std::size_t sample_size(sample_format_t f)
+{
+	switch(f)
+	{
+		case sample_format_t::f32: return sizeof(float);
+		case sample_format_t::f64: return sizeof(double);
+		case sample_format_t::s16: return sizeof(int16_t);
+		case sample_format_t::s24: return sizeof(int24);
+		case sample_format_t::s32: return sizeof(int32_t);
+	}
+	return 0;
+}
+
+namespace detail {
+
+template<class S>
+void convert_from(const S* src, void* dst, sample_format_t dst_format,
+	std::size_t size, float gain)
+{
+	switch(dst_format)
+	{
+		case sample_format_t::f32:
+			convert(src, static_cast<float*>(dst), size, gain);
+			break;
+		case sample_format_t::f64:
+			convert(src, static_cast<double*>(dst), size, gain);
+			break;
+		case sample_format_t::s16:
+			convert(src, static_cast<int16_t*>(dst), size, gain);
+			break;
+		case sample_format_t::s24:
+			convert(src, static_cast<int24*>(dst), size, gain);
+			break;
+		case sample_format_t::s32:
+			convert(src, static_cast<int32_t*>(dst), size, gain);
+			break;
+	}
+}
+
+}
+
+//! convert() for formats that are only known at runtime, e.g. from
+//! sample_format_of(). The dispatch happens once per call, the loop is
+//! the same as in convert().
+inline void convert(const void* src, sample_format_t src_format,
+	void* dst, sample_format_t dst_format, std::size_t size,
+	float gain = 1.0f)
+{
+	switch(src_format)
+	{
+		case sample_format_t::f32:
+			detail::convert_from(static_cast<const float*>(src),
+				dst, dst_format, size, gain);
+			break;
+		case sample_format_t::f64:
+			detail::convert_from(static_cast<const double*>(src),
+				dst, dst_format, size, gain);
+			break;
+		case sample_format_t::s16:
+			detail::convert_from(static_cast<const int16_t*>(src),
+				dst, dst_format, size, gain);
+			break;
+		case sample_format_t::s24:
+			detail::convert_from(static_cast<const int24*>(src),
+				dst, dst_format, size, gain);
+			break;
+		case sample_format_t::s32:
+			detail::convert_from(static_cast<const int32_t*>(src),
+				dst, dst_format, size, gain);
+			break;
+	}
+}
+
+} // namespace audio
+} // namespace spa
+
+#endif // SPA_AUDIO_CONVERT_H
@@ -22,18 +22,41 @@
 #ifndef SPA_AUDIO_FWD_H
 #define SPA_AUDIO_FWD_H
 
+#include <cstdint>
+
 namespace spa {
 namespace audio {
 
 class invalid_args_error;
 
+class buffer_port;
+class buffer_flags;
+
 namespace stereo {
 	class in;
 	class out;
 }
 
+namespace bus {
+	template<class T> class bus_base;
+	class in;
+	class out;
+}
+
+namespace flat {
+	template<class T> struct buffer;
+	template<class T> class port_base;
+	class in;
+	class out;
+}
+
 class in;
 class out;
+struct int24;
+enum class sample_format_t;
+template<class T> struct sample_format;
+template<class T> class pcm_in;
+template<class T> class pcm_out;
 enum class scale_type_t;
 
 template<class T> class control_in;
@@ -41,6 +64,12 @@ template<class T> class control_out;
 class samplerate;
 class buffersize;
 class samplecount;
+class tail;
+
+enum class event_type : uint8_t;
+struct event;
+class event_in;
+class event_out;
 
 class osc_ringbuffer;
 class osc_ringbuffer_in;
@@ -0,0 +1,575 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file audio_host.h
+	audio utils that only hosts use: buffers fulfilling the requirements
+	of buffer_port, in-place connection, event buffers, denormal handling,
+	idle tracking and block splitting
+
+	Plugins never see these types, so they are built on std::vector.
+*/
+
+#ifndef SPA_AUDIO_HOST_H
+#define SPA_AUDIO_HOST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+#include "audio.h"
+
+namespace spa {
+namespace audio {
+
+//! alignment and padding (in bytes) that host buffers use by default,
+//! enough for all common SIMD widths and one cache line
+constexpr const unsigned default_buffer_alignment = 64;
+
+//! audio buffer for hosts, aligned and padded such that it can be
+//! connected to any buffer_port with requirements up to its own
+template<class T>
+class aligned_buffer
+{
+	T* _data = nullptr;
+	std::size_t _size = 0;
+	unsigned _alignment, _padding;
+
+	void mdelete() { std::free(_data); _data = nullptr; }
+public:
+	//! Return a pointer to the buffer
+	T* data() noexcept { return _data; }
+	//! Return a pointer to the buffer
+	const T* data() const noexcept { return _data; }
+	//! Return the number of usable elements (without padding)
+	std::size_t size() const noexcept { return _size; }
+
+	T& operator[](std::size_t idx) noexcept { return _data[idx]; }
+	const T& operator[](std::size_t idx) const noexcept {
+		return _data[idx]; }
+
+	//! Return whether this buffer can be connected to port @p p
+	bool fulfills(const buffer_port& p) const noexcept {
+		return p.alignment <= _alignment && p.padding <= _padding; }
+
+	//! Reallocate the buffer to hold @p size elements, plus padding.
+	//! All elements, including the padding, will be zeroed.
+	//! If the allocation fails, the buffer is left unchanged.
+	//! @note Pointers that have been connected to ports become invalid
+	void resize(std::size_t size) noexcept(false)
+	{
+		std::size_t bytes = size * sizeof(T);
+		// round up to padding, but allocate at least one padding unit
+		const std::size_t pad = _padding;
+		bytes = bytes ? ((bytes + pad - 1) & ~(pad - 1)) : pad;
+		void* ptr;
+		unsigned align = (_alignment < sizeof(void*))
+			? sizeof(void*) : _alignment;
+		if(posix_memalign(&ptr, align, bytes))
+			throw std::bad_alloc();
+		std::memset(ptr, 0, bytes);
+		mdelete();
+		_data = static_cast<T*>(ptr);
+		_size = size;
+	}
+
+	//! Construct an empty buffer. Alignment and padding (in bytes) must
+	//! be powers of 2
+	aligned_buffer(unsigned alignment = default_buffer_alignment,
+		unsigned padding = default_buffer_alignment) noexcept :
+		_alignment(alignment), _padding(padding) {}
+	aligned_buffer(aligned_buffer&& other) noexcept :
+		_data(other._data), _size(other._size),
+		_alignment(other._alignment), _padding(other._padding) {
+		other._data = nullptr;
+		other._size = 0;
+	}
+	aligned_buffer(const aligned_buffer& other) = delete;
+	~aligned_buffer() { mdelete(); }
+};
+
+/*
+	buffer flags
+*/
+
+//! scan @p size samples of @p buf for buffer_flag_t hints
+//! Use this for buffers where the flags are not known otherwise, e.g. for
+//! buffers from files or hardware. Plugin outputs already carry their flags.
+//! @return combination of silent and constant
+template<class T>
+int scan_flags(const T* buf, std::size_t size)
+{
+	if(!size)
+		return silent | constant;
+	const T first = buf[0];
+	for(std::size_t i = 1; i < size; ++i)
+		if(buf[i] != first)
+			return 0;
+	return (first == T()) ? (silent | constant) : constant;
+}
+
+/*
+	in-place processing
+*/
+
+//! if the plugin supports in-place processing for @p p, connect it to the
+//! buffers of the corresponding input port, which must already be connected
+//! @return true iff @p p was connected
+inline bool connect_in_place(stereo::out& p)
+{
+	if(p.in_place && p.in_place->left && p.in_place->right)
+	{
+		// the plugin allowed us to write where it reads
+		p.left = const_cast<float*>(p.in_place->left);
+		p.right = const_cast<float*>(p.in_place->right);
+		return true;
+	}
+	else
+		return false;
+}
+
+//! @copydoc connect_in_place(stereo::out&)
+inline bool connect_in_place(out& p)
+{
+	if(p.in_place && p.in_place->get_ref())
+	{
+		p.set_ref(const_cast<float*>(p.in_place->get_ref()));
+		return true;
+	}
+	else
+		return false;
+}
+
+//! @copydoc connect_in_place(stereo::out&)
+inline bool connect_in_place(flat::out& p)
+{
+	if(p.in_place && p.in_place->target->data)
+	{
+		p.connect(const_cast<float*>(p.in_place->target->data));
+		return true;
+	}
+	else
+		return false;
+}
+
+//! @copydoc connect_in_place(stereo::out&)
+template<class T>
+bool connect_in_place(pcm_out<T>& p)
+{
+	if(p.in_place && p.in_place->get_ref())
+	{
+		p.set_ref(const_cast<T*>(p.in_place->get_ref()));
+		return true;
+	}
+	else
+		return false;
+}
+
+//! @copydoc connect_in_place(stereo::out&)
+inline bool connect_in_place(bus::out& p)
+{
+	if(p.in_place && p.in_place->channels == p.channels)
+	{
+		if(p.in_place->layout() == bus::planar &&
+			p.in_place->planar_buffers() &&
+			(p.layouts & bus::planar))
+		{
+			p.connect_planar(const_cast<float* const*>(
+				p.in_place->planar_buffers()));
+			return true;
+		}
+		if(p.in_place->layout() == bus::interleaved &&
+			p.in_place->interleaved_buffer() &&
+			(p.layouts & bus::interleaved))
+		{
+			p.connect_interleaved(const_cast<float*>(
+				p.in_place->interleaved_buffer()));
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+	events
+*/
+
+//! host side storage for the events of one block, for event_in and
+//! event_out ports
+class event_buffer
+{
+	std::vector<event> events;
+	bool sorted = true;
+public:
+	//! reserve space for @p capacity events, so no allocations happen
+	//! on the audio thread
+	explicit event_buffer(std::size_t capacity = 1024) {
+		events.reserve(capacity); }
+
+	//! add an event, in any order of event::frame
+	void push(const event& ev)
+	{
+		sorted = sorted && (events.empty() ||
+			events.back().frame <= ev.frame);
+		events.push_back(ev);
+	}
+
+	void note_on(uint32_t frame, uint8_t channel, uint8_t key,
+		uint8_t velocity) {
+		push(event { frame, event_type::note_on, channel, key,
+			velocity });
+	}
+
+	void note_off(uint32_t frame, uint8_t channel, uint8_t key,
+		uint8_t velocity = 0) {
+		push(event { frame, event_type::note_off, channel, key,
+			velocity });
+	}
+
+	//! remove all events, e.g. after the block has been processed
+	void clear() { events.clear(); sorted = true; }
+
+	std::size_t size() const { return events.size(); }
+
+	//! sort the events by frame (stable) and let @p p read them
+	void connect(event_in& p)
+	{
+		if(!sorted)
+		{
+			std::stable_sort(events.begin(), events.end(),
+				[](const event& e1, const event& e2) {
+					return e1.frame < e2.frame; });
+			sorted = true;
+		}
+		p.events = events.data();
+		p.count = static_cast<unsigned>(events.size());
+	}
+
+	//! let the plugin write up to capacity() events into this buffer
+	void connect(event_out& p)
+	{
+		events.resize(events.capacity());
+		p.events = events.data();
+		p.capacity = static_cast<unsigned>(events.size());
+		p.count = 0;
+	}
+
+	//! after plugin::run(), take over the events written to @p p
+	void collect(const event_out& p) { events.resize(p.count); }
+
+	std::size_t capacity() const { return events.capacity(); }
+	const event* begin() const { return events.data(); }
+	const event* end() const { return events.data() + events.size(); }
+};
+
+/*
+	denormals
+*/
+
+//! Sets the FPU to flush subnormal floats to zero (FTZ) and to treat
+//! subnormal inputs as zero (DAZ) while it is in scope, and restores the
+//! previous mode afterwards. Use it around plugin::run(), since decaying
+//! signals (e.g. reverb tails) end up in subnormals, which are processed
+//! far slower on most CPUs. Skip it for plugins that set
+//! descriptor::properties::needs_subnormals.
+//!
+//! Supported on x86 with SSE (MXCSR) and on aarch64 (FPCR, where FZ
+//! covers both), a no-op elsewhere. The mode is per thread, so the guard
+//! must be created in the thread that runs the plugin.
+class denormal_guard
+{
+#if defined(__SSE__) || defined(__x86_64__)
+	using mode_t = unsigned;
+	static mode_t get() { return _mm_getcsr(); }
+	static void set(mode_t m) { _mm_setcsr(m); }
+	static constexpr const mode_t flush = 0x8040; //!< FTZ | DAZ
+#elif defined(__aarch64__)
+	using mode_t = uint64_t;
+	static mode_t get() {
+		mode_t m; __asm__ __volatile__("mrs %0, fpcr" : "=r"(m));
+		return m; }
+	static void set(mode_t m) {
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(m)); }
+	static constexpr const mode_t flush = mode_t(1) << 24; //!< FZ
+#else
+	using mode_t = unsigned;
+	static mode_t get() { return 0; }
+	static void set(mode_t ) {}
+	static constexpr const mode_t flush = 0;
+#endif
+	mode_t saved;
+	bool active;
+public:
+	//! @param enable false to leave the mode untouched
+	explicit denormal_guard(bool enable = true) :
+		saved(enable ? get() : 0),
+		active(enable && (saved & flush) != flush)
+	{
+		if(active)
+			set(saved | flush);
+	}
+	denormal_guard(const denormal_guard& ) = delete;
+	~denormal_guard()
+	{
+		if(active)
+			set(saved);
+	}
+};
+
+/*
+	idle plugins
+*/
+
+//! Decides in which periods a plugin with a tail port must be run, such
+//! that idle plugins (e.g. silent instruments, or effects whose tail has
+//! ended) cost nothing. Plugins without a tail port are never idle.
+//! In each period:
+//! @code
+//! if(tracker.need_run(new_input)) {
+//! 	plug.run();
+//! 	tracker.ran();
+//! } else if(tracker.first_skip())
+//! 	; // clear the outputs
+//! @endcode
+//! While the plugin is skipped, the host must treat its outputs as silent,
+//! e.g. clear them in the first skipped period and set
+//! buffer_flags::silent for the plugins reading them.
+class idle_tracker
+{
+	unsigned value = tail_infinite; //!< connected to the tail port
+	bool idle = false;
+	unsigned skipped = 0; //!< periods skipped in a row, up to 2
+public:
+	//! connect the plugin's tail port to this tracker
+	void connect(tail& p) { p.set_ref(&value); }
+
+	//! call before each period
+	//! @param new_input whether the plugin gets input in this period
+	//!   that may wake it: non-silent audio, events or OSC messages
+	//! @return whether plugin::run() must be called in this period
+	bool need_run(bool new_input)
+	{
+		if(new_input || !idle)
+		{
+			idle = false;
+			skipped = 0;
+			value = tail_infinite;
+			return true;
+		}
+		if(skipped < 2)
+			++skipped;
+		return false;
+	}
+
+	//! call after plugin::run()
+	void ran() { idle = !value; }
+
+	//! whether need_run() has returned false for the first time since
+	//! the plugin has been run last
+	bool first_skip() const { return skipped == 1; }
+
+	//! run the plugin in the next period again, e.g. after its state
+	//! has been changed by the host
+	void wake() { idle = false; }
+
+	//! whether the plugin can be skipped unless new input arrives
+	bool is_idle() const { return idle; }
+	//! frames in which the output may still be non-silent, as reported
+	//! by the last plugin::run()
+	unsigned remaining() const { return value; }
+};
+
+/*
+	block splitting
+*/
+
+//! Runs a plugin for one period in multiple sub-blocks, split at event
+//! boundaries (e.g. OSC timestamps, tempo changes, loop points).
+//! For each sub-block, the buffer pointers are advanced and the samplecount
+//! is set, without reconnecting any ports.
+//! Plugins without a samplecount port always process whole periods, so for
+//! them, the period is never split, and the events are quantised to the
+//! period. Add the samplecount port with add(samplecount&) to enable
+//! splitting.
+//! Splits are rounded down to multiples of granularity(), such that each
+//! sub-block starts with the alignment that the ports require (see
+//! buffer_port), and no sub-block but the last one ends inside a padding
+//! unit. Otherwise, plugins that process whole padding units could
+//! overwrite input of the next sub-block if they work in-place.
+//! @note Event ports (event_in) are sample accurate already and need no
+//!   splitting
+class block_splitter
+{
+	struct buffer_ref
+	{
+		void* ref;
+		void (*advance)(void* ref, std::ptrdiff_t frames);
+	};
+	std::vector<buffer_ref> buffers;
+	bool splittable = false; //!< plugin has a samplecount port
+	unsigned granule = 1; //!< splits must be multiples of this
+
+	template<class T>
+	static void advance_ptr(void* ref, std::ptrdiff_t frames) {
+		*static_cast<T**>(ref) += frames; }
+	template<class T>
+	static void advance_port(void* ref, std::ptrdiff_t frames) {
+		port_ref<T>& p = *static_cast<port_ref<T>*>(ref);
+		p.set_ref(p.get_ref() + frames);
+	}
+	template<class T>
+	static void advance_bus(void* ref, std::ptrdiff_t frames) {
+		bus::bus_base<T>& p = *static_cast<bus::bus_base<T>*>(ref);
+		p.connect_interleaved(p.interleaved_buffer()
+			+ frames * static_cast<std::ptrdiff_t>(p.channels));
+	}
+	template<class T>
+	void add_bus(bus::bus_base<T>& p) noexcept(false)
+	{
+		// the channel array of planar busses is const, the host must
+		// add its elements instead
+		if(p.layout() != bus::interleaved)
+			throw exception("add the channel pointers of planar "
+				"busses to the block_splitter");
+		buffers.push_back({&p, &advance_bus<T>});
+		align_to(p, p.channels * sizeof(T));
+	}
+	void advance(std::ptrdiff_t frames)
+	{
+		for(const buffer_ref& b : buffers)
+			b.advance(b.ref, frames);
+	}
+public:
+	//! let the plugin be run on parts of a period, since it has the
+	//! samplecount port @p p (connected to the variable passed to run())
+	void add(samplecount& ) { splittable = true; }
+
+	//! let the splitter advance the buffer pointer @p ptr, e.g. an
+	//! element of the channel array of a planar bus::in. Call align_to()
+	//! with the bus, too.
+	template<class T>
+	void add(T*& ptr) { buffers.push_back({&ptr, &advance_ptr<T>}); }
+	//! add an interleaved bus; for planar busses, add the elements of
+	//! their channel arrays instead
+	//! @throw exception if the bus is connected planar
+	void add(bus::in& p) noexcept(false) { add_bus(p); }
+	//! @copydoc add(bus::in&)
+	void add(bus::out& p) noexcept(false) { add_bus(p); }
+	void add(stereo::in& p) { add(p.left); add(p.right); align_to(p); }
+	void add(stereo::out& p) { add(p.left); add(p.right); align_to(p); }
+	void add(flat::in& p) { add(p.target->data); align_to(p); }
+	void add(flat::out& p) { add(p.target->data); align_to(p); }
+	void add(in& p) {
+		buffers.push_back({static_cast<port_ref<const float>*>(&p),
+			&advance_port<const float>});
+		align_to(p); }
+	void add(out& p) {
+		buffers.push_back({static_cast<port_ref<float>*>(&p),
+			&advance_port<float>});
+		align_to(p); }
+	template<class T>
+	void add(pcm_in<T>& p) {
+		buffers.push_back({static_cast<port_ref<const T>*>(&p),
+			&advance_port<const T>});
+		align_to(p, sizeof(T)); }
+	template<class T>
+	void add(pcm_out<T>& p) {
+		buffers.push_back({static_cast<port_ref<T>*>(&p),
+			&advance_port<T>});
+		align_to(p, sizeof(T)); }
+
+	//! round splits such that the buffers of port @p p, which have
+	//! @p frame_bytes bytes per frame, keep their alignment and padding
+	//! in each sub-block (done by add(), except for planar busses)
+	void align_to(const buffer_port& p,
+		std::size_t frame_bytes = sizeof(float))
+	{
+		// all values are powers of 2, so the least common multiple of
+		// the granules is the largest one
+		unsigned frames = std::max(p.alignment, p.padding);
+		for(; frames > 1 && !(frame_bytes & 1); frame_bytes >>= 1)
+			frames >>= 1;
+		granule = std::max(granule, frames);
+	}
+
+	//! forget all buffers and the samplecount port, e.g. when
+	//! reconnecting the plugin
+	void clear() { buffers.clear(); splittable = false; granule = 1; }
+
+	//! whether the plugin can be run on parts of a period
+	bool splits() const { return splittable; }
+	//! the number of frames that all splits are multiples of
+	unsigned granularity() const { return granule; }
+
+	//! run @p plug for @p period frames
+	//! @param samplecount the host variable connected to the plugin's
+	//!   samplecount port
+	//! @param splits frames where sub-blocks shall start, sorted
+	//!   ascending; they are rounded down to multiples of granularity(),
+	//!   splits at 0 or beyond @p period are ignored, and all of them if
+	//!   the plugin has no samplecount port
+	//! @param on_block called as on_block(first_frame, frames) before
+	//!   each sub-block is run, e.g. to send the OSC messages for it
+	template<class Callback>
+	void run(plugin& plug, unsigned& samplecount, unsigned period,
+		const unsigned* splits, std::size_t n_splits,
+		Callback&& on_block)
+	{
+		run(plug, samplecount, period, splits, n_splits, on_block,
+			[](plugin& p) { p.run(); });
+	}
+
+	//! like above, but let @p runner call plug.run() for each sub-block
+	//! as runner(plug), e.g. to wrap only run() in an rt_scope
+	template<class Callback, class Runner>
+	void run(plugin& plug, unsigned& samplecount, unsigned period,
+		const unsigned* splits, std::size_t n_splits,
+		Callback&& on_block, Runner&& runner)
+	{
+		if(!splittable)
+			n_splits = 0;
+		unsigned pos = 0;
+		for(std::size_t i = 0; i <= n_splits; ++i)
+		{
+			unsigned end = (i == n_splits) ? period
+				: splits[i] / granule * granule;
+			if(end <= pos || end > period)
+				continue;
+			on_block(pos, end - pos);
+			samplecount = end - pos;
+			runner(plug);
+			advance(end - pos);
+			pos = end;
+		}
+		// restore the pointers for the next period
+		advance(-static_cast<std::ptrdiff_t>(pos));
+	}
+};
+
+} // namespace audio
+} // namespace spa
+
+#endif // SPA_AUDIO_HOST_H
@@ -0,0 +1,144 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file audio_render.h
+	utils for hosts that render offline, i.e. faster than realtime: a
+	double buffered WAV or raw file writer and frame accurate OSC
+	automation
+
+	The writer thread and the automation list are host internals, which is
+	why std::thread and std::vector are fine here.
+*/
+
+#ifndef SPA_AUDIO_RENDER_H
+#define SPA_AUDIO_RENDER_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "audio.h"
+
+namespace spa {
+namespace audio {
+
+//! Streams interleaved float samples into a WAV or raw file.
+//! Samples are collected in one of two buffers, while a writer thread
+//! writes the other one, so the rendering thread never waits for the disk
+//! unless the disk is slower than the rendering.
+class file_writer
+{
+public:
+	enum class format_t
+	{
+		wav, //!< 32 bit float WAV
+		raw  //!< headerless, interleaved 32 bit floats (native endian)
+	};
+
+	//! open @p path for writing
+	//! @param block_frames frames per buffer that is handed to the disk
+	//! @throw std::runtime_error if the file can not be opened
+	file_writer(const char* path, format_t format, unsigned channels,
+		unsigned long samplerate, std::size_t block_frames = 65536)
+		noexcept(false);
+	file_writer(const file_writer& ) = delete;
+	~file_writer();
+
+	//! append @p frames frames, @p channels contains one pointer per
+	//! channel
+	void write(const float* const* channels, std::size_t frames);
+
+	//! write all remaining samples and close the file
+	//! @return false if any write has failed
+	bool close();
+
+	//! WAV for paths ending in ".wav", otherwise raw
+	static format_t format_of(const char* path);
+
+	unsigned long long frames_written() const { return total_frames; }
+
+private:
+	std::FILE* file;
+	const format_t format;
+	const unsigned channels;
+	const unsigned long samplerate;
+
+	std::vector<float> buffers[2];
+	std::size_t used[2] = { 0, 0 }; //!< samples, per buffer
+	bool full[2] = { false, false }; //!< buffer waits for the disk
+	unsigned current = 0; //!< buffer being filled
+	unsigned long long total_frames = 0;
+	bool failed = false, quit = false;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread writer;
+
+	void write_header();
+	//! hand the current buffer to the writer thread
+	void submit();
+	void writer_main();
+};
+
+//! OSC automation with frame accurate timestamps, e.g. for offline renders
+//! Messages are encoded once on loading, so sending them costs no parsing.
+class automation
+{
+	struct message
+	{
+		unsigned long long frame;
+		std::vector<char> data;
+	};
+	std::vector<message> messages; //!< sorted by frame
+	std::size_t next = 0; //!< first message that has not been sent
+public:
+	//! Add the messages from file @p path, which has one message per line:
+	//! @code <frame> <path> <types> [<arguments>]@endcode
+	//! e.g. "48000 /gain f 0.5". Supported types are i, h, f, d, s (no
+	//! whitespace), T, F, N and I. Empty lines and lines starting with
+	//! "#" are ignored.
+	//! @throw std::runtime_error on IO or syntax errors
+	void load(const char* path) noexcept(false);
+
+	//! add one message at @p frame
+	void add(unsigned long long frame, const char* path, const char* types,
+		const pseudo_rtosc::rtosc_arg_t* args);
+
+	//! append the frames in (@p first, @p first + @p frames) where
+	//! messages are due to @p splits, relative to @p first
+	//! (see block_splitter::run())
+	void splits(unsigned long long first, unsigned frames,
+		std::vector<unsigned>& splits) const;
+
+	//! send all messages before frame @p end that have not been sent
+	void send(osc_ringbuffer& rb, unsigned long long end);
+
+	//! start sending from the first message again
+	void rewind() { next = 0; }
+
+	std::size_t size() const { return messages.size(); }
+};
+
+} // namespace audio
+} // namespace spa
+
+#endif // SPA_AUDIO_RENDER_H
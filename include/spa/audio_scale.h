@@ -0,0 +1,191 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file audio_scale.h
+	mapping between normalized values in [0, 1] and the values of control
+	ports, using their scale_type, min and max
+*/
+
+#ifndef SPA_AUDIO_SCALE_H
+#define SPA_AUDIO_SCALE_H
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "audio.h"
+
+namespace spa {
+namespace audio {
+
+//! approximation of log2(x) for normal, positive @p x
+//! The absolute error is below 4e-7 for x in [2^-8, 2^8] and below 4e-6
+//! for all normal x, where it is dominated by the rounding of the result
+//! to float; no library calls
+inline float fast_log2(float x)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	int exponent = static_cast<int>((bits >> 23) & 0xff) - 127;
+	bits = (bits & 0x007fffff) | 0x3f800000;
+	float m; // mantissa, in [1, 2)
+	std::memcpy(&m, &bits, sizeof(m));
+	// move m into [sqrt(1/2), sqrt(2)) for faster convergence
+	if(m > 1.41421356f) { m *= 0.5f; ++exponent; }
+	// log2(m) = 2/ln(2) * atanh(t), with t in (-0.172, 0.172)
+	const float t = (m - 1.0f) / (m + 1.0f), t2 = t * t;
+	return static_cast<float>(exponent) + t * (2.88539008f + t2 *
+		(0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+}
+
+//! approximation of 2^x, with @p x being clamped to [-126, 127]
+//! The relative error is below 3e-7; no library calls
+inline float fast_exp2(float x)
+{
+	x = (x < -126.0f) ? -126.0f : ((x > 127.0f) ? 127.0f : x);
+	// round to nearest (the argument of the cast is positive)
+	const int i = static_cast<int>(x + 128.5f) - 128;
+	const float f = x - static_cast<float>(i); // in [-0.5, 0.5]
+	// Taylor series of e^(f*ln(2))
+	const float p = 1.0f + f * (0.693147181f + f * (0.240226507f +
+		f * (0.0555041087f + f * (0.00961812911f +
+		f * (0.00133335581f + f * 0.000154035304f)))));
+	const uint32_t bits = static_cast<uint32_t>(i + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+//! Maps between normalized values in [0, 1] (e.g. knob positions or
+//! automation) and the values of a control port. All logarithms of the
+//! port's range are computed once, on construction.
+//! For logarithmic scales, min and max must be positive.
+//! The computation is done in float, so the range is clamped to
+//! [-max_abs, max_abs], e.g. for the unlimited default range of
+//! control_in<double>.
+template<class T>
+class scale_map
+{
+	scale_type_t type;
+	float base;  //!< linear: min, logarithmic: log2(min)
+	float range; //!< linear: max - min, logarithmic: log2(max / min)
+	float min_value, max_value, step; //!< after clamping
+
+	static T from_real(float x)
+	{
+		// round integers to nearest instead of truncating
+		return std::is_integral<T>::value
+			? static_cast<T>(x + ((x < 0.0f) ? -0.5f : 0.5f))
+			: static_cast<T>(x);
+	}
+	static float clamp01(float x) {
+		return (x < 0.0f) ? 0.0f : ((x > 1.0f) ? 1.0f : x); }
+	bool is_log() const { return type == scale_type_t::logartihmic; }
+	static float clamp_range(T x)
+	{
+		const double d = static_cast<double>(x);
+		return static_cast<float>((d < -max_abs) ? -max_abs
+			: ((d > max_abs) ? max_abs : d));
+	}
+	//! round @p x to the nearest step from the minimum, within the range
+	float apply_step(float x) const
+	{
+		if(!(step > 0.0f))
+			return x;
+		x = min_value + std::round((x - min_value) / step) * step;
+		return (x > max_value) ? x - step : x;
+	}
+	float value_at(float normalized) const
+	{
+		const float x = base + clamp01(normalized) * range;
+		return apply_step(is_log() ? fast_exp2(x) : x);
+	}
+public:
+	//! largest absolute value of the range, such that the range itself
+	//! is still a finite float
+	static constexpr const double max_abs =
+		std::numeric_limits<float>::max() / 2;
+
+	//! @param step if positive, values are rounded to the nearest
+	//!   multiple of @p step from @p min
+	//! @throw exception if min or max is NaN, or if the scale is
+	//!   logarithmic and @p min is not positive
+	scale_map(scale_type_t type, T min, T max, T step = T())
+		noexcept(false) :
+		type(type),
+		min_value(clamp_range(min)),
+		max_value(clamp_range(max)),
+		step(clamp_range(step))
+	{
+		if(std::isnan(min_value) || std::isnan(max_value))
+			throw exception("scale_map: range is NaN");
+		if(is_log() && !(min_value > 0.0f))
+			throw exception("scale_map: logarithmic scales need a "
+				"positive range");
+		base = is_log() ? std::log2(min_value) : min_value;
+		range = is_log() ? (std::log2(max_value) - base)
+			: (max_value - min_value);
+	}
+
+	//! construct from a control_in<T> or control_out<T>
+	//! @note The port's step is not applied, since it defaults to 1 even
+	//!   for floating point ports. Pass it to the other constructor.
+	template<class Port>
+	explicit scale_map(const Port& p) noexcept(false) :
+		scale_map(p.scale_type, p.min, p.max) {}
+
+	//! map @p normalized (clamped to [0, 1]) to a port value
+	T to_value(float normalized) const {
+		return from_real(value_at(normalized)); }
+
+	//! map port value @p value to [0, 1]
+	float to_normalized(T value) const
+	{
+		const float v = static_cast<float>(value);
+		return range ? clamp01(((is_log() ? fast_log2(v) : v) - base)
+			/ range) : 0.0f;
+	}
+
+	//! map @p size normalized values to port values, e.g. for a block of
+	//! automation
+	void to_values(const float* normalized, T* values,
+		std::size_t size) const
+	{
+		for(std::size_t i = 0; i < size; ++i)
+			values[i] = from_real(value_at(normalized[i]));
+	}
+
+	//! map @p size port values to normalized values
+	void to_normalized(const T* values, float* normalized,
+		std::size_t size) const
+	{
+		for(std::size_t i = 0; i < size; ++i)
+			normalized[i] = to_normalized(values[i]);
+	}
+};
+
+template<class T>
+constexpr const double scale_map<T>::max_abs;
+
+} // namespace audio
+} // namespace spa
+
+#endif // SPA_AUDIO_SCALE_H
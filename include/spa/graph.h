@@ -0,0 +1,294 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file graph.h
+	multi-core processing of plugin graphs, and planning which signals
+	share buffers, for hosts only
+
+	The graph is built and compiled by the host outside of the audio
+	thread, so it keeps its nodes and edges in std::vector. Only
+	graph::process() must be realtime safe, and it does not allocate.
+*/
+
+#ifndef SPA_GRAPH_H
+#define SPA_GRAPH_H
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+
+#include "spa.h"
+
+namespace spa {
+
+namespace detail {
+
+//! Chase-Lev work stealing deque with a fixed capacity, which must be a
+//! power of 2. The owner pushes and pops at the bottom, all other threads
+//! steal from the top. No operation allocates or locks.
+class work_deque
+{
+	std::atomic<long> top, bottom;
+	std::unique_ptr<std::atomic<unsigned>[]> buf;
+	long mask = 0;
+public:
+	work_deque() : top(0), bottom(0) {}
+
+	//! allocate, must not be called while other threads use the deque
+	void reserve(std::size_t capacity)
+	{
+		buf.reset(new std::atomic<unsigned>[capacity]);
+		mask = static_cast<long>(capacity) - 1;
+		top.store(0);
+		bottom.store(0);
+	}
+
+	//! owner only; the deque must not be full
+	void push(unsigned x)
+	{
+		const long b = bottom.load(std::memory_order_relaxed);
+		buf[b & mask].store(x, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	//! owner only
+	bool pop(unsigned& x)
+	{
+		const long b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long t = top.load(std::memory_order_relaxed);
+		bool found = t <= b;
+		if(found)
+		{
+			x = buf[b & mask].load(std::memory_order_relaxed);
+			if(t == b)
+			{
+				// last element: race against thieves
+				found = top.compare_exchange_strong(t, t + 1,
+					std::memory_order_seq_cst,
+					std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+		}
+		else
+			bottom.store(b + 1, std::memory_order_relaxed);
+		return found;
+	}
+
+	//! any thread
+	bool steal(unsigned& x)
+	{
+		long t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const long b = bottom.load(std::memory_order_acquire);
+		if(t >= b)
+			return false;
+		x = buf[t & mask].load(std::memory_order_relaxed);
+		return top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+};
+
+//! Counting semaphore for waking threads. Posting neither allocates nor
+//! locks. Uses an unnamed POSIX semaphore, or a dispatch semaphore on
+//! macOS, which does not implement unnamed POSIX semaphores.
+class semaphore
+{
+#ifdef __APPLE__
+	dispatch_semaphore_t sem;
+public:
+	semaphore() : sem(dispatch_semaphore_create(0)) {}
+	~semaphore() { dispatch_release(sem); }
+	void post() { dispatch_semaphore_signal(sem); }
+	void wait() { dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER); }
+#else
+	sem_t sem;
+public:
+	semaphore() { sem_init(&sem, 0, 0); }
+	~semaphore() { sem_destroy(&sem); }
+	void post() { sem_post(&sem); }
+	void wait() { while(sem_wait(&sem) && errno == EINTR) ; }
+#endif
+	semaphore(const semaphore& ) = delete;
+};
+
+}
+
+//! A directed acyclic graph of plugin instances, which runs each period
+//! on a work stealing thread pool.
+//!
+//! An edge from node a to node b means that b reads what a writes, so b
+//! runs after a, while nodes without a path between them may run in
+//! parallel. Which thread runs which node changes from period to period.
+//! The thread that calls process() (usually the audio thread) works as
+//! well, so with 0 workers, the graph is simply run in topological order.
+//!
+//! Each plugin runs under an audio::denormal_guard, unless it has been
+//! added as needing subnormals.
+//!
+//! Within process(), nothing allocates and no locks are taken. Pending
+//! dependencies are tracked with atomic counters, idle workers sleep on a
+//! semaphore (see detail::semaphore), which process() posts once per
+//! worker.
+//!
+//! Connecting the plugins' ports is up to the host, which must do it before
+//! start() or between stop() and start().
+class graph
+{
+public:
+	using node_id = unsigned;
+
+	//! add plugin @p plug as a node, if the graph is stopped
+	//! @param needs_subnormals whether the plugin must run without
+	//!   flushing subnormals to zero (see
+	//!   descriptor::properties::needs_subnormals)
+	//! @return the id of the new node, counting from 0
+	node_id add(plugin& plug, bool needs_subnormals = false)
+		noexcept(false);
+	//! let node @p to run after node @p from, if the graph is stopped
+	void connect(node_id from, node_id to) noexcept(false);
+
+	//! prepare processing (allocating) and start @p n_workers threads in
+	//! addition to the thread calling process()
+	//! @throw exception if the graph contains a cycle
+	void start(unsigned n_workers) noexcept(false);
+	//! stop and join the worker threads
+	void stop();
+	bool running() const { return started; }
+
+	//! run all plugins once, returning when all of them have finished
+	//! Must only be called between start() and stop(), from one thread.
+	void process();
+
+	std::size_t size() const { return plugins.size(); }
+	//! number of threads that process() uses, including the calling one
+	unsigned threads() const { return n_threads; }
+
+	//! the nodes that @p node must run after
+	std::vector<node_id> predecessors(node_id node) const;
+	//! the nodes that must run after @p node
+	std::vector<node_id> successors(node_id node) const;
+	//! all node ids, each one after all its predecessors
+	//! @throw exception if the graph contains a cycle
+	std::vector<node_id> topological_order() const noexcept(false);
+
+	graph() : remaining(0), quit(false) {}
+	graph(const graph& ) = delete;
+	~graph();
+
+private:
+	// construction
+	std::vector<plugin*> plugins;
+	std::vector<bool> flush; //!< whether to flush subnormals, per node
+	std::vector<std::pair<node_id, node_id>> edges;
+
+	// compiled on start()
+	std::vector<unsigned> n_deps;    //!< number of predecessors
+	std::vector<unsigned> succ_begin; //!< index into succ, per node
+	std::vector<node_id> succ;       //!< successors of all nodes
+	std::vector<node_id> roots;      //!< nodes without predecessors
+	std::unique_ptr<std::atomic<unsigned>[]> pending;
+	std::unique_ptr<detail::work_deque[]> deques; //!< one per thread
+
+	std::atomic<unsigned> remaining; //!< nodes not yet finished
+	std::atomic<bool> quit;
+	//! only exists between start() and stop()
+	std::unique_ptr<detail::semaphore> wakeup;
+	std::vector<std::thread> workers;
+	unsigned n_threads = 1;
+	bool started = false;
+
+	void compile() noexcept(false);
+	void worker_main(unsigned self);
+	//! run nodes until all of them have finished
+	void work(unsigned self);
+	bool steal(unsigned self, node_id& node);
+	void execute(unsigned self, node_id node);
+};
+
+//! Plans which signals of a graph share which buffers, so hosts need far
+//! fewer buffers than plugin outputs and the buffers stay warm in the cache.
+//!
+//! A signal is one buffer written by one node (e.g. one channel of an
+//! output port) and read by any nodes. After a signal's last reader has
+//! run, its buffer is reused for a later signal. A buffer is only reused if
+//! all users of the previous signal are ancestors of the new writer in the
+//! graph, so the plan is also safe while the graph runs on multiple cores.
+//! Plugins that can process in-place (see e.g. audio::stereo::out::in_place)
+//! may write their output into the buffer of their input.
+//!
+//! An output and the inputs that read it get the same buffer, so connecting
+//! plugins never costs a copy.
+class buffer_plan
+{
+public:
+	using signal_id = unsigned;
+
+	//! add a signal written by node @p writer
+	signal_id add_signal(graph::node_id writer);
+	//! let node @p reader read signal @p signal
+	void add_reader(signal_id signal, graph::node_id reader);
+	//! let the writer of @p out write it into the buffer of @p in, if
+	//! possible. The writer of @p out must read @p in.
+	void allow_in_place(signal_id out, signal_id in);
+	//! never reuse the buffer of @p signal, e.g. because the host reads it
+	//! after graph::process()
+	void keep(signal_id signal);
+
+	//! compute the plan (allocating), for the graph @p g that contains
+	//! all writers and readers
+	//! @return the number of buffers needed
+	unsigned plan(const graph& g) noexcept(false);
+
+	//! after plan(): index of the buffer that @p signal uses
+	unsigned buffer_of(signal_id signal) const { return buffer[signal]; }
+	//! after plan(): number of buffers needed
+	unsigned buffers() const { return n_buffers; }
+	std::size_t size() const { return signals.size(); }
+
+private:
+	struct signal
+	{
+		graph::node_id writer;
+		std::vector<graph::node_id> readers;
+		signal_id in_place_of;
+		bool kept;
+	};
+	static constexpr const signal_id no_signal =
+		static_cast<signal_id>(-1);
+	std::vector<signal> signals;
+	std::vector<unsigned> buffer;
+	unsigned n_buffers = 0;
+};
+
+} // namespace spa
+
+#endif // SPA_GRAPH_H
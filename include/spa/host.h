@@ -0,0 +1,491 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file host.h
+	utils for hosts, for managing plugin instances: saving and loading
+	in the background, a pool of prepared instances, timing of run() and
+	state snapshots
+
+	The plugin only sees its own functions being called, never these
+	classes, so they use std::thread, std::function and the containers
+	freely.
+*/
+
+#ifndef SPA_HOST_H
+#define SPA_HOST_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "spa.h"
+
+namespace spa {
+
+/*
+	ports
+*/
+
+//! return the number of ports in descriptor::port_table(), or 0 if the
+//! descriptor has no port table
+inline unsigned port_count(const descriptor& desc)
+{
+	unsigned count = 0;
+	if(const char* const* table = desc.port_table())
+		for(; table[count]; ++count) ;
+	return count;
+}
+
+//! notify the plugin that the host has changed the value of the port with
+//! index @p idx (see plugin::changed_ports())
+inline void mark_changed(plugin& plug, unsigned idx)
+{
+	if(port_bitset* changed = plug.changed_ports())
+		changed->set(idx);
+}
+
+/*
+	save and load
+*/
+
+//! Runs the ticketed save and load requests of one plugin slot (see
+//! plugin::save() and plugin::load()) in a background thread, while the
+//! audio thread keeps running the plugin.
+//!
+//! Loading happens in a second instance, which is swapped in at a block
+//! boundary once load_check() succeeds. Until then, the old instance keeps
+//! running with the old state. For saving, the audio thread captures the
+//! running instance's state at a block boundary (see
+//! plugin::snapshot_save()), and a second instance, restored from that
+//! snapshot, saves in the background. This requires
+//! descriptor::snapshot_has().
+//!
+//! The audio thread only calls acquire(), which does not lock or allocate.
+//! save() and load() are only called on instances that are not run, so
+//! the audio thread counts as stopped for them.
+class state_worker
+{
+public:
+	//! creates a new instance, connected and initialized like the
+	//! running one, such that it can be run after the swap
+	using factory_t = std::function<plugin*()>;
+	//! deactivates and deletes an instance
+	using disposer_t = std::function<void(plugin*)>;
+
+	enum class status_t
+	{
+		pending, //!< not finished yet
+		done,    //!< succeeded
+		failed,  //!< failed, was not supported or timed out
+		unknown  //!< no such ticket
+	};
+
+	//! @param running the instance that the audio thread runs now.
+	//!   Instances that are swapped out are passed to @p disposer.
+	//! @param timeout how long to wait for save_check() and load_check()
+	state_worker(const descriptor& desc, plugin& running,
+		factory_t factory, disposer_t disposer,
+		std::chrono::milliseconds timeout = std::chrono::seconds(10));
+	state_worker(const state_worker& ) = delete;
+	//! stops the background thread; jobs that did not start are dropped
+	~state_worker();
+
+	//! Audio thread only: call this at each block boundary and run the
+	//! returned instance for the next block. This swaps in newly loaded
+	//! instances and serves save requests.
+	plugin& acquire();
+
+	//! Return the instance that has been returned by acquire() last.
+	//! Only safe to call from the audio thread, or if it is stopped.
+	plugin& running() const { return *current; }
+
+	//! load @p savefile into a new instance, in the background
+	//! @return the ticket to check the status with status()
+	uint64_t load(const std::string& savefile);
+	//! save the state of the running instance to @p savefile, in the
+	//! background. Fails if the descriptor has no snapshot support.
+	//! @return the ticket to check the status with status()
+	uint64_t save(const std::string& savefile);
+
+	//! Return the status of the job with ticket @p ticket
+	status_t status(uint64_t ticket) const;
+	//! block until the job with ticket @p ticket has finished
+	status_t wait(uint64_t ticket) const;
+
+private:
+	enum class kind_t { load, save };
+	struct job
+	{
+		kind_t kind;
+		std::string savefile;
+		uint64_t ticket;
+	};
+
+	//! states of a snapshot request that the audio thread serves
+	enum save_state_t : int
+	{
+		save_idle,
+		save_requested, //!< worker -> audio thread: snapshot_save()
+		save_busy,      //!< audio thread is calling snapshot_save()
+		save_captured,  //!< audio thread -> worker: see save_size
+		save_canceled   //!< the worker has timed out
+	};
+
+	const descriptor& desc;
+	const factory_t factory;
+	const disposer_t disposer;
+	const std::chrono::milliseconds timeout;
+
+	// audio thread
+	plugin* current;
+
+	// lock free exchange between the worker and the audio thread
+	std::atomic<plugin*> ready;   //!< loaded instance, to be swapped in
+	std::atomic<plugin*> retired; //!< swapped out, to be disposed
+	std::atomic<int> save_state;
+	// published by save_state
+	void* save_buffer = nullptr;
+	std::size_t save_capacity = 0;
+	std::size_t save_size = 0; //!< return value of snapshot_save()
+
+	// non-realtime threads only
+	mutable std::mutex mutex;
+	mutable std::condition_variable cv;
+	std::deque<job> jobs;
+	std::map<uint64_t, status_t> results;
+	uint64_t next_ticket = 0;
+	bool quit = false;
+	std::thread worker;
+
+	uint64_t enqueue(kind_t kind, const std::string& savefile);
+	void worker_main();
+	bool run_load(const job& j);
+	bool run_save(const job& j);
+	//! let the audio thread capture the running instance's state into
+	//! @p buffer (see plugin::snapshot_save())
+	//! @return false on timeout, otherwise the result is in save_size
+	bool capture(void* buffer, std::size_t capacity);
+	//! poll @p done every millisecond until it returns true
+	//! @return false on timeout or if the worker shall quit
+	bool poll(const std::function<bool()>& done);
+};
+
+/*
+	instance pool
+*/
+
+//! Keeps instances of one plugin instantiated and initialized in the
+//! background, such that inserting the plugin only needs
+//! plugin::activate().
+//!
+//! The pool size adapts to the usage: it grows when instances are taken
+//! faster than they are being prepared, and shrinks by one instance per
+//! decay period without any take(). It never holds more instances than
+//! the memory budget allows.
+class instance_pool
+{
+public:
+	//! creates an instance with connected ports, on which init() has
+	//! been called, but not activate()
+	using factory_t = std::function<plugin*()>;
+	//! deletes an instance that has never been activated
+	using disposer_t = std::function<void(plugin*)>;
+
+	//! @param instance_bytes estimated memory per instance
+	//! @param memory_budget memory that the waiting instances may use
+	//! @param min_size number of instances to keep at least (if the
+	//!   budget allows it)
+	//! @param decay time without take() after which the pool shrinks
+	instance_pool(factory_t factory, disposer_t disposer,
+		std::size_t instance_bytes, std::size_t memory_budget,
+		unsigned min_size = 1,
+		std::chrono::seconds decay = std::chrono::seconds(30));
+	instance_pool(const instance_pool& ) = delete;
+	//! stops the background thread and disposes all waiting instances
+	~instance_pool();
+
+	//! Return a prepared instance, or nullptr if none is ready (then the
+	//! host must create one itself). Does not wait for the background
+	//! thread.
+	plugin* take();
+
+	//! number of instances that are ready
+	std::size_t available() const;
+	//! number of instances that the pool currently aims for
+	unsigned target_size() const;
+
+private:
+	const factory_t factory;
+	const disposer_t disposer;
+	const unsigned max_size; //!< due to the memory budget
+	const unsigned min_size;
+	const std::chrono::seconds decay;
+
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<plugin*> ready;
+	unsigned target;
+	std::chrono::steady_clock::time_point last_use;
+	bool quit = false;
+	std::thread worker;
+
+	void worker_main();
+};
+
+/*
+	run() timing
+*/
+
+//! Timing statistics of plugin::run() of one instance, e.g. to find the
+//! plugins that cause dropouts. The audio thread records each call with a
+//! run_timer, any other thread (e.g. the UI) may read() at any time.
+//!
+//! Recording costs two clock_gettime() calls (no syscalls on Linux) and a
+//! few relaxed atomic stores, since there is only one writer per instance.
+//! Readers never block the audio thread, but may see the call that is
+//! being recorded in some values and not yet in others.
+class run_stats
+{
+public:
+	//! number of histogram buckets; bucket i counts the calls that took
+	//! [2^i, 2^(i+1)) ns, the last one also all longer calls
+	static constexpr const unsigned n_buckets = 32;
+
+	//! the statistics at one point in time
+	struct totals
+	{
+		long samplerate;
+		uint64_t calls;
+		uint64_t frames;         //!< sum of the calls' block sizes
+		uint64_t ns;             //!< sum of the calls' durations
+		uint64_t max_ns;         //!< longest call
+		uint64_t peak_load_ppm;  //!< highest load of a call, in ppm
+		uint64_t histogram[n_buckets];
+
+		//! Mean load, in percent of the block deadline, which is the
+		//! duration of the processed frames at the samplerate
+		double load() const;
+		//! highest load of a single call, in percent
+		double peak_load() const { return peak_load_ppm / 10000.; }
+		//! The statistics of the calls between @p earlier and this,
+		//! e.g. for the load of the last second. max_ns and the peak
+		//! load are still those since the start.
+		totals since(const totals& earlier) const;
+	};
+
+	explicit run_stats(long samplerate = 48000);
+	run_stats(const run_stats& ) = delete;
+
+	//! must not be called while calls are being recorded
+	void set_samplerate(long rate) { samplerate = rate; }
+
+	//! audio thread only: add a call that took @p ns nanoseconds for
+	//! @p frames frames
+	void record(uint64_t ns, unsigned frames)
+	{
+		add(n_calls, 1);
+		add(n_frames, frames);
+		add(sum_ns, ns);
+		if(ns > max_ns.load(std::memory_order_relaxed))
+			max_ns.store(ns, std::memory_order_relaxed);
+		if(frames)
+		{
+			const uint64_t ppm = ns
+				* static_cast<uint64_t>(samplerate)
+				/ (frames * uint64_t(1000));
+			if(ppm > peak_ppm.load(std::memory_order_relaxed))
+				peak_ppm.store(ppm, std::memory_order_relaxed);
+		}
+		const unsigned bucket = ns ? highest_bit(ns) : 0;
+		add(histogram[bucket < n_buckets ? bucket : n_buckets - 1], 1);
+	}
+
+	//! any thread: read the statistics, without locking
+	totals read() const;
+
+	//! monotonic time in nanoseconds
+	static uint64_t now_ns()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000u
+			+ static_cast<uint64_t>(ts.tv_nsec);
+	}
+
+private:
+	long samplerate;
+	std::atomic<uint64_t> n_calls, n_frames, sum_ns, max_ns, peak_ppm;
+	std::atomic<uint64_t> histogram[n_buckets];
+
+	//! single writer, so no read-modify-write is needed
+	static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value,
+			std::memory_order_relaxed); }
+	//! index of the highest set bit of @p x, which must not be 0
+	static unsigned highest_bit(uint64_t x) noexcept
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return 63 - static_cast<unsigned>(__builtin_clzll(x));
+#else
+		unsigned idx = 0;
+		while(x >>= 1)
+			++idx;
+		return idx;
+#endif
+	}
+};
+
+//! Records the duration of its lifetime in a run_stats, e.g. around
+//! plugin::run() (or around all runs of one split block)
+class run_timer
+{
+	run_stats& stats;
+	const unsigned frames;
+	const uint64_t start;
+public:
+	run_timer(run_stats& stats, unsigned frames) :
+		stats(stats), frames(frames), start(run_stats::now_ns()) {}
+	run_timer(const run_timer& ) = delete;
+	~run_timer() { stats.record(run_stats::now_ns() - start, frames); }
+};
+
+/*
+	snapshots
+*/
+
+//! version of the snapshot layout
+constexpr const uint32_t snapshot_version = 1;
+
+//! Layout of a snapshot in memory or in files. All offsets are relative to
+//! the header and all sections are 8 byte aligned, so snapshots (or banks
+//! of them) can be memory-mapped and restored in-place.
+struct snapshot_header
+{
+	char magic[8];         //!< "spasnap" with terminating zero
+	uint32_t version;      //!< snapshot_version
+	uint32_t header_size;  //!< sizeof(snapshot_header)
+	uint64_t total_size;   //!< size of header and all sections, in bytes
+	uint64_t controls_offset, controls_size; //!< host's control values
+	uint64_t state_offset, state_size; //!< see plugin::snapshot_save()
+};
+
+//! position of one control port's value in the host's control block
+struct control_slot
+{
+	unsigned port;   //!< port index, see plugin::port_at()
+	uint32_t offset; //!< offset of the value in the control block
+	uint32_t size;   //!< size of the value, in bytes
+};
+
+//! Read-only view of a snapshot, e.g. in a memory-mapped file
+class snapshot_view
+{
+	const snapshot_header* header = nullptr;
+	const char* bytes() const {
+		return reinterpret_cast<const char*>(header); }
+public:
+	snapshot_view() = default;
+	//! view the @p size bytes at @p data, which must be 8 byte aligned;
+	//! check valid() afterwards, which rejects malformed headers
+	snapshot_view(const void* data, std::size_t size);
+
+	//! whether the data is a complete snapshot of a known version
+	bool valid() const { return header; }
+	std::size_t size() const { return header->total_size; }
+
+	const void* controls() const {
+		return bytes() + header->controls_offset; }
+	std::size_t controls_size() const { return header->controls_size; }
+	const void* state() const { return bytes() + header->state_offset; }
+	std::size_t state_size() const { return header->state_size; }
+
+	//! Copy the control values into @p controls, which must have the size
+	//! of the captured controls, and load the plugin's state into @p plug.
+	//! This does not allocate (unless the plugin does), so it can be done
+	//! from the audio thread between two calls of run().
+	//! @return true on success
+	bool restore(plugin& plug, void* controls,
+		std::size_t control_bytes) const;
+
+	//! Copy only the control values that differ between the snapshot and
+	//! @p controls and set their port indices in @p changed, e.g. in
+	//! plugin::changed_ports() or for plugin::restore_changed().
+	//! Unchanged values are not written, so nothing that depends on them
+	//! needs to be recomputed. This does not allocate.
+	//! @param slots the positions of all control values in @p controls
+	//! @return the number of changed values, or -1 if @p control_bytes
+	//!   does not match the snapshot
+	int restore_controls(void* controls, std::size_t control_bytes,
+		const control_slot* slots, std::size_t n_slots,
+		port_bitset* changed) const;
+
+	//! Like restore(), but only copy the control values that differ (see
+	//! restore_controls()), and tell the plugin which ports have changed
+	//! by calling plugin::restore_changed() with @p changed.
+	//! This does not allocate (unless the plugin does).
+	//! @param changed cleared, then filled with the changed ports
+	//! @param ticket passed to plugin::restore_changed()
+	//! @return true on success
+	bool restore(plugin& plug, void* controls, std::size_t control_bytes,
+		const control_slot* slots, std::size_t n_slots,
+		port_bitset& changed, uint64_t ticket) const;
+};
+
+//! Snapshot of a plugin's state and the host's control values, in memory.
+//! Hosts should keep the values of all control ports of one plugin in one
+//! contiguous block, such that they are captured and restored by a single
+//! copy.
+class snapshot
+{
+	std::vector<uint64_t> storage; //!< uint64_t for the alignment
+public:
+	//! capture @p control_bytes bytes at @p controls and the state of
+	//! @p plug (allocating)
+	void capture(plugin& plug, const void* controls,
+		std::size_t control_bytes);
+
+	snapshot_view view() const { return snapshot_view(data(), size()); }
+	bool restore(plugin& plug, void* controls,
+		std::size_t control_bytes) const {
+		return view().restore(plug, controls, control_bytes); }
+	bool restore(plugin& plug, void* controls, std::size_t control_bytes,
+		const control_slot* slots, std::size_t n_slots,
+		port_bitset& changed, uint64_t ticket) const {
+		return view().restore(plug, controls, control_bytes,
+			slots, n_slots, changed, ticket); }
+
+	//! the raw data, e.g. to store it in a file
+	const void* data() const { return storage.data(); }
+	std::size_t size() const { return storage.size() * sizeof(uint64_t); }
+};
+
+} // namespace spa
+
+#endif // SPA_HOST_H
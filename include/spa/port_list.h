@@ -0,0 +1,225 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file port_list.h
+	compile time port lists, which implement plugin::port(),
+	plugin::port_at(), descriptor::port_names() and descriptor::port_table()
+
+	Usage, inside your plugin class:
+	@code
+	SPA_PORT(in);                // port "in" is member "in"
+	SPA_PORT_NAMED(osc, osc_in); // port "osc" is member "osc_in"
+	public:
+	using ports = spa::port_list<my_plugin, port_in, port_osc>;
+	@endcode
+*/
+
+#ifndef SPA_PORT_LIST_H
+#define SPA_PORT_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "spa.h"
+
+//! declare a port entry for spa::port_list, named "port_<name>", for the
+//! plugin member @p member, which can be found as @p name
+#define SPA_PORT_NAMED(name, member) \
+	struct port_##name \
+	{ \
+		static constexpr const char* port_name() { return #name; } \
+		template<class Plugin> \
+		static spa::port_ref_base& get(Plugin& p) { return p.member; } \
+	}
+
+//! declare a port entry for spa::port_list for the plugin member @p member,
+//! which can be found as a port with the same name
+#define SPA_PORT(member) SPA_PORT_NAMED(member, member)
+
+namespace spa {
+
+namespace detail {
+
+//! FNV-1a hash, at compile time
+constexpr uint32_t fnv1a(const char* str, uint32_t hash = 2166136261u)
+{
+	return *str ? fnv1a(str + 1, (hash ^ static_cast<uint8_t>(*str))
+		* 16777619u) : hash;
+}
+
+//! FNV-1a hash, at run time (no recursion)
+inline uint32_t fnv1a_rt(const char* str)
+{
+	uint32_t hash = 2166136261u;
+	for(; *str; ++str)
+		hash = (hash ^ static_cast<uint8_t>(*str)) * 16777619u;
+	return hash;
+}
+
+//! smallest power of 2 which is at least 2 * @p n
+constexpr std::size_t table_size(std::size_t n, std::size_t m = 1)
+{
+	return (m >= 2 * n) ? m : table_size(n, 2 * m);
+}
+
+//! first index in [lo, hi) whose hash falls into bucket @p b, or @p none
+//! (divide and conquer, to keep the recursion depth logarithmic)
+template<std::size_t N>
+constexpr unsigned first_in_bucket(const uint32_t (&hashes)[N], uint32_t mask,
+	uint32_t b, std::size_t lo, std::size_t hi, unsigned none)
+{
+	return (hi - lo == 0) ? none
+		: (hi - lo == 1) ? (((hashes[lo] & mask) == b)
+			? static_cast<unsigned>(lo) : none)
+		: (first_in_bucket(hashes, mask, b, lo, lo + (hi - lo) / 2,
+			none) != none)
+			? first_in_bucket(hashes, mask, b, lo,
+				lo + (hi - lo) / 2, none)
+			: first_in_bucket(hashes, mask, b, lo + (hi - lo) / 2,
+				hi, none);
+}
+
+template<std::size_t... I> struct index_sequence {};
+
+//! concatenate two index sequences, the second one shifted by @p N1
+template<class S1, class S2, std::size_t N1> struct concat_seq;
+template<std::size_t... I1, std::size_t... I2, std::size_t N1>
+struct concat_seq<index_sequence<I1...>, index_sequence<I2...>, N1> {
+	using type = index_sequence<I1..., (N1 + I2)...>; };
+
+//! index_sequence<0, ..., N-1>, with logarithmic instantiation depth
+template<std::size_t N> struct make_index_sequence
+{
+	using type = typename concat_seq<
+		typename make_index_sequence<N / 2>::type,
+		typename make_index_sequence<N - N / 2>::type, N / 2>::type;
+};
+template<> struct make_index_sequence<0> { using type = index_sequence<>; };
+template<> struct make_index_sequence<1> { using type = index_sequence<0>; };
+
+//! array that can be returned by constexpr functions
+template<std::size_t N> struct index_array { unsigned v[N]; };
+
+}
+
+//! Compile time list of a plugin's ports, given as port entries (see
+//! SPA_PORT). All port metadata and a hash table of the port names are
+//! computed at compile time, so no allocations or hash table setup happen
+//! at run time. Looking up a name costs one hash of the name plus usually
+//! one string comparison.
+//! @note The hash table is computed with O(N^2) constexpr steps. For very
+//!   large port lists, the compiler's constexpr limits may need to be raised
+//!   (e.g. -fconstexpr-ops-limit for gcc, -fconstexpr-steps for clang).
+template<class Plugin, class... Ports>
+class port_list
+{
+	static_assert(sizeof...(Ports) > 0, "port list must not be empty");
+
+	using getter_t = port_ref_base& (*)(Plugin&);
+
+	static constexpr std::size_t n = sizeof...(Ports);
+	static constexpr std::size_t m = detail::table_size(n);
+	static constexpr uint32_t mask = static_cast<uint32_t>(m - 1);
+	static constexpr unsigned none = static_cast<unsigned>(n);
+
+	template<std::size_t... I>
+	static constexpr detail::index_array<m> make_first(
+		detail::index_sequence<I...>) {
+		return detail::index_array<m>{{ detail::first_in_bucket(hashes,
+			mask, static_cast<uint32_t>(I), 0, n, none)... }};
+	}
+
+	template<std::size_t... I>
+	static constexpr detail::index_array<n> make_next(
+		detail::index_sequence<I...>) {
+		return detail::index_array<n>{{ detail::first_in_bucket(
+			hashes, mask, hashes[I] & mask, I + 1, n, none)... }};
+	}
+
+	static constexpr getter_t getters[n] = {
+		&Ports::template get<Plugin>... };
+	static constexpr uint32_t hashes[n] = {
+		detail::fnv1a(Ports::port_name())... };
+	//! first port index for each bucket
+	static const detail::index_array<m> first;
+	//! next port index in the same bucket, for each port index
+	static const detail::index_array<n> next;
+
+public:
+	//! nullptr-terminated port names, see descriptor::port_table()
+	static constexpr const char* const names[n + 1] = {
+		Ports::port_name()..., nullptr };
+
+	//! Return the number of ports
+	static constexpr unsigned size() { return static_cast<unsigned>(n); }
+
+	//! Return the index of the port with name @p path, or size()
+	static unsigned index_of(const char* path)
+	{
+		const uint32_t hash = detail::fnv1a_rt(path);
+		for(unsigned i = first.v[hash & mask]; i != none; i = next.v[i])
+			if(hashes[i] == hash && detail::m_streq(names[i], path))
+				return i;
+		return none;
+	}
+
+	//! implementation for plugin::port_at()
+	static port_ref_base* port_at(Plugin& plugin, unsigned index) {
+		return (index < n) ? &getters[index](plugin) : nullptr; }
+
+	//! implementation for plugin::port()
+	static port_ref_base& port(Plugin& plugin, const char* path)
+		noexcept(false)
+	{
+		const unsigned index = index_of(path);
+		if(index == none)
+			throw port_not_found(path);
+		return getters[index](plugin);
+	}
+
+	//! implementation for descriptor::port_table()
+	static const char* const* port_table() { return names; }
+
+	//! implementation for descriptor::port_names()
+	static simple_vec<simple_str> port_names() {
+		return simple_vec<simple_str>(Ports::port_name()...); }
+};
+
+template<class Plugin, class... Ports>
+constexpr typename port_list<Plugin, Ports...>::getter_t
+	port_list<Plugin, Ports...>::getters[];
+template<class Plugin, class... Ports>
+constexpr uint32_t port_list<Plugin, Ports...>::hashes[];
+template<class Plugin, class... Ports>
+constexpr const char* const port_list<Plugin, Ports...>::names[];
+template<class Plugin, class... Ports>
+const detail::index_array<port_list<Plugin, Ports...>::m>
+	port_list<Plugin, Ports...>::first =
+	port_list<Plugin, Ports...>::make_first(
+		typename detail::make_index_sequence<m>::type());
+template<class Plugin, class... Ports>
+const detail::index_array<port_list<Plugin, Ports...>::n>
+	port_list<Plugin, Ports...>::next =
+	port_list<Plugin, Ports...>::make_next(
+		typename detail::make_index_sequence<n>::type());
+
+} // namespace spa
+
+#endif // SPA_PORT_LIST_H
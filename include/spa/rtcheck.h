@@ -0,0 +1,85 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file rtcheck.h
+	marking realtime code for the RT-safety checker, for hosts only
+
+	The checker is the shared library libspa-rtcheck.so, which is loaded
+	with LD_PRELOAD:
+	@code LD_PRELOAD=libspa-rtcheck.so ./my-host my-plugin.so@endcode
+	While a thread is inside an rt_scope, it reports each call to malloc,
+	free, the aligned allocation functions, new, delete, mutexes,
+	condition variables, semaphores, common blocking syscalls and stdio
+	functions (which iostreams use as well) with a backtrace to stderr.
+	The aligned new and delete operators of C++17 are only checked if the
+	checker has been compiled as C++17 or later. If SPA_RTCHECK_ABORT is
+	set in the environment, the first violation aborts the program, so it
+	can be inspected in a debugger. Without the checker, rt_scope costs one
+	branch.
+*/
+
+#ifndef SPA_RTCHECK_H
+#define SPA_RTCHECK_H
+
+extern "C" {
+//! defined by the checker, if it is loaded
+void spa_rtcheck_enter(const char* what) __attribute__((weak));
+//! defined by the checker, if it is loaded
+void spa_rtcheck_leave() __attribute__((weak));
+//! defined by the checker, if it is loaded
+unsigned long spa_rtcheck_violations() __attribute__((weak));
+}
+
+namespace spa {
+
+//! Marks its lifetime as realtime critical for the RT-safety checker, e.g.
+//! around plugin::run() of plugins that claim
+//! descriptor::properties::hard_rt_capable. Scopes may be nested.
+class rt_scope
+{
+	const bool active;
+public:
+	//! @param what name for the reports, e.g. the plugin's label. Must
+	//!   live as long as the scope.
+	//! @param enable false to check nothing
+	explicit rt_scope(const char* what, bool enable = true) :
+		active(enable && spa_rtcheck_enter)
+	{
+		if(active)
+			spa_rtcheck_enter(what);
+	}
+	rt_scope(const rt_scope& ) = delete;
+	~rt_scope()
+	{
+		if(active)
+			spa_rtcheck_leave();
+	}
+};
+
+//! Return the number of violations that the checker has reported so far,
+//! or 0 if it is not loaded, e.g. to let tests fail
+inline unsigned long rt_violations()
+{
+	return spa_rtcheck_violations ? spa_rtcheck_violations() : 0;
+}
+
+} // namespace spa
+
+#endif // SPA_RTCHECK_H
@@ -314,6 +314,86 @@ public:
 	simple_str(const simple_str& other) = delete;
 };
 
+//! bitset of port indices (see plugin::port_at()), e.g. to mark changed
+//! ports. Use port_bits to create one.
+class port_bitset
+{
+protected:
+	using word_t = unsigned long long;
+	static constexpr unsigned word_bits = 64;
+	word_t* const words;
+	const unsigned n_words;
+
+	port_bitset(word_t* words, unsigned n_words) :
+		words(words), n_words(n_words) {}
+
+	//! index of the lowest set bit of @p w, which must not be 0
+	static unsigned lowest_bit(word_t w) noexcept
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<unsigned>(__builtin_ctzll(w));
+#else
+		unsigned idx = 0;
+		for(; !(w & 1); w >>= 1)
+			++idx;
+		return idx;
+#endif
+	}
+public:
+	//! Return the number of port indices that can be stored
+	unsigned size() const noexcept { return n_words * word_bits; }
+
+	void set(unsigned idx) noexcept {
+		words[idx / word_bits] |= word_t(1) << (idx % word_bits); }
+	void reset(unsigned idx) noexcept {
+		words[idx / word_bits] &= ~(word_t(1) << (idx % word_bits)); }
+	bool test(unsigned idx) const noexcept {
+		return (words[idx / word_bits] >> (idx % word_bits)) & 1; }
+
+	//! Return whether any bit is set
+	bool any() const noexcept
+	{
+		for(unsigned i = 0; i < n_words; ++i)
+			if(words[i])
+				return true;
+		return false;
+	}
+
+	//! Clear all bits
+	void clear() noexcept
+	{
+		for(unsigned i = 0; i < n_words; ++i)
+			words[i] = 0;
+	}
+
+	//! Call @p f(idx) for each set bit in ascending order and clear all
+	//! bits. The cost depends on the number of set bits, not on the
+	//! number of ports (except for one check per 64 ports).
+	template<class F>
+	void consume(F&& f)
+	{
+		for(unsigned i = 0; i < n_words; ++i)
+		{
+			word_t w = words[i];
+			words[i] = 0;
+			for(; w; w &= w - 1) // clear the lowest set bit
+				f(i * word_bits + lowest_bit(w));
+		}
+	}
+};
+
+//! port_bitset with storage for @p N port indices
+template<unsigned N>
+class port_bits : public port_bitset
+{
+	word_t storage[(N + word_bits - 1) / word_bits];
+public:
+	port_bits() noexcept :
+		port_bitset(storage, (N + word_bits - 1) / word_bits) {
+		clear(); }
+	port_bits(const port_bits& ) = delete;
+};
+
 //! direction, as seen from the plugin
 enum direction_t {
 	input = 1, //!< data from host to plugin
@@ -354,7 +434,7 @@ public:
 template<class T>
 class port_ref : public virtual port_ref_base
 {
-	T* ref;
+	T* ref = nullptr;
 public:
 	SPA_OBJECT
 
@@ -372,6 +452,7 @@ public:
 	const T& operator[](int i) const { return ref[i]; }
 
 	void set_ref(T* pointer) { ref = pointer; }
+	T* get_ref() const { return ref; }
 //	void set_ref(const T* pointer) { ref = pointer; }
 };
 
@@ -526,9 +607,60 @@ public:
 #define SPA_MK_VISIT(type, base) \
 	virtual void visit(type& p) { visit(static_cast<base&>(p)); }
 
+//! use this in every visitor class that accept functions cast to (i.e.
+//! visitor classes of libraries), so visitor_cast() finds it without RTTI
+//! @param vis_id number that identifies the visitor class, e.g. in
+//!   debuggers (spa uses 0 to 15)
+//! @param base the visitor base class
+//! @note Visitor classes may derive from multiple visitor classes, e.g. to
+//!   visit the ports of multiple libraries. Classes without SPA_VISITOR
+//!   still work with visitor_cast(), but they are found more slowly.
+#define SPA_VISITOR(vis_id, base) \
+	static constexpr unsigned id = vis_id; \
+	spa::visitor::registrar spa_visitor_registrar = \
+		spa::visitor::registrar(this);
+
 class visitor
 {
+	template<class V> friend V& visitor_cast(visitor& v) noexcept(false);
+
+	//! key of visitor class @p V, unique across all visitor classes
+	template<class V>
+	struct key_of { static const char key; };
+
+	//! fast path for visitor_cast(): the visitor classes (with
+	//! SPA_VISITOR) that this object has been constructed as
+	struct fast_entry
+	{
+		const char* key;
+		void* self;
+	};
+	static constexpr unsigned max_fast = 4;
+	fast_entry fast[max_fast];
+	unsigned n_fast = 0;
+
 public:
+	//! id of this visitor class, see SPA_VISITOR
+	static constexpr unsigned id = 0;
+
+	//! registers a visitor class for visitor_cast(), see SPA_VISITOR
+	struct registrar
+	{
+		template<class V>
+		explicit registrar(V* self)
+		{
+			visitor& v = *self;
+			if(v.n_fast < max_fast)
+				v.fast[v.n_fast++] = { &key_of<V>::key, self };
+		}
+	};
+
+	visitor() = default;
+	//! copies are found by the slow path of visitor_cast() only, since
+	//! the fast path points to the original
+	visitor(const visitor& ) : visitor() {}
+	visitor& operator=(const visitor& ) { return *this; }
+
 	virtual void visit(port_ref_base& ) {}
 
 #define SPA_MK_VISIT_PR(type) \
@@ -556,17 +688,41 @@ public:
 	virtual ~visitor();
 };
 
+template<class V>
+const char visitor::key_of<V>::key = 0;
+
+//! cast visitor @p v to visitor class @p V
+//! If @p V uses SPA_VISITOR, this is a comparison of a few pointers,
+//! otherwise (or if the pointers differ, e.g. between shared libraries),
+//! it falls back to dynamic_cast.
+//! @throws exception if @p v is not derived from @p V
+template<class V>
+V& visitor_cast(visitor& v) noexcept(false)
+{
+	for(unsigned i = 0; i < v.n_fast; ++i)
+		if(v.fast[i].key == &visitor::key_of<V>::key)
+			return *static_cast<V*>(v.fast[i].self);
+	V* res = dynamic_cast<V*>(&v);
+	if(!res)
+		throw exception("visitor can not visit this port type");
+	return *res;
+}
+
+template<>
+inline visitor& visitor_cast<visitor>(visitor& v) noexcept(false) {
+	return v; }
+
 //! define an accept function for a (non-template) class
 #define ACCEPT(classname, visitor_type)\
 	void classname::accept(class spa::visitor& v) {\
-		dynamic_cast<visitor_type&>(v).visit(*this);\
+		spa::visitor_cast<visitor_type>(v).visit(*this);\
 	}
 
 //! define an accept function for a template class
 #define ACCEPT_T(classname, visitor_type)\
 	template<class T>\
 	void classname<T>::accept(class spa::visitor& v) {\
-		dynamic_cast<visitor_type&>(v).visit(*this);\
+		spa::visitor_cast<visitor_type>(v).visit(*this);\
 	}
 
 ACCEPT_T(port_ref, spa::visitor)
@@ -577,7 +733,18 @@ class plugin
 {
 public:
 	/*
-		TODO: specify threads
+		Threads: the host calls run() (and descriptor::run_batch()) from
+		a realtime thread, but not necessarily from the same thread each
+		time, e.g. when it runs a plugin graph on multiple cores. The
+		host guarantees that:
+		 * no function of an instance is called while run() of that
+		   instance is being executed
+		 * everything written by one call of run() is visible to the
+		   next call of run(), even if it happens on another thread
+		 * run() of different instances may be executed at the same
+		   time, so instances must not share unsynchronized state
+		All other functions are called from non-realtime threads while
+		run() is not being executed, unless stated otherwise.
 	*/
 	//! Must do one computation, depending on however this is defined
 	//! E.g. if it's an audio plugin and has a sample count port, this
@@ -618,6 +785,20 @@ public:
 	//! unchanged, but recognize changed ports
 	virtual void restore(uint64_t ticket) { (void)ticket; }
 
+	//! Like restore(), but the host tells what has changed since the last
+	//! snapshot, e.g. for undo or automation recall, so the plugin only
+	//! needs to reapply that. The success is checked by restore_check().
+	//! @param ports indices (see port_at()) of the changed ports, or
+	//!   nullptr if no port has changed
+	//! @param paths nullptr-terminated array of changed OSC paths, or
+	//!   nullptr if no OSC path has changed
+	//! The default implementation restores everything.
+	virtual void restore_changed(uint64_t ticket, const port_bitset* ports,
+		const char* const* paths) {
+		(void)ports;
+		(void)paths;
+		restore(ticket); }
+
 	//! Check if a requested save operation succeeded
 	virtual bool save_check(const char* savefile, uint64_t ticket) {
 		(void)savefile;
@@ -635,12 +816,54 @@ public:
 		(void)ticket;
 		return false; }
 
+	//! Serialize the plugin's state (everything that the host can not
+	//! read from the ports) into @p buffer, which has @p size bytes.
+	//! The data must not contain pointers, such that hosts can keep it in
+	//! memory, store it in files or memory-map it.
+	//! Must not be called while run() is being executed. If possible,
+	//! avoid allocations and syscalls, so hosts can switch presets
+	//! between two calls of run().
+	//! @return the number of bytes that the state needs. If this is larger
+	//!   than @p size, nothing has been written (e.g. if @p buffer is
+	//!   nullptr). 0 means that snapshots are not supported.
+	virtual std::size_t snapshot_save(void* buffer, std::size_t size) {
+		(void)buffer;
+		(void)size;
+		return 0; }
+
+	//! Restore a state from @p size bytes at @p buffer, which have been
+	//! written by snapshot_save() of any instance of the same plugin.
+	//! The same thread rules as for snapshot_save() apply.
+	//! @return true iff the state could be restored
+	virtual bool snapshot_load(const void* buffer, std::size_t size) {
+		(void)buffer;
+		(void)size;
+		return false; }
+
 	//! Destructor, must clean up any allocated memory
 	virtual ~plugin();
 
 	//! Return the port with name @p path (or throw port_not_found)
 	virtual port_ref_base& port(const char* path) = 0;
 
+	//! Return the port with index @p index, where the index is the
+	//! position in descriptor::port_table(), or nullptr if there is no
+	//! such port. This must not throw and should not do any string
+	//! operations, so hosts can connect thousands of ports quickly.
+	//! Only required if descriptor::port_table() is implemented.
+	virtual port_ref_base* port_at(unsigned index) {
+		(void)index;
+		return nullptr; }
+
+	//! Return the set of port indices (see port_at()) whose values the
+	//! host has changed since the plugin has last cleared them, or
+	//! nullptr if the plugin does not track changes.
+	//! The host sets the bits (e.g. using mark_changed() from host.h) in
+	//! the thread which calls run(), the plugin consumes them in run().
+	//! This way, plugins only need to recompute what depends on changed
+	//! ports.
+	virtual port_bitset* changed_ports() { return nullptr; }
+
 	//! show or hide the external UI
 	virtual void ui_ext_show(bool show) { (void)show; }
 
@@ -764,6 +987,9 @@ public:
 	//! Should return an XPM array for a preview logo, or nullptr
 	virtual const char** xpm_load() const { return nullptr; }
 
+	//! Constructor, which clears all properties
+	descriptor() : properties() {}
+
 	//! Desctructor, must clean up any allocated memory
 	virtual ~descriptor();
 
@@ -773,12 +999,41 @@ public:
 	//! dnd, or if they are in an old-versioned savefile.
 	virtual simple_vec<simple_str> port_names() const = 0;
 
+	//! Return a static, nullptr-terminated array of all port names that
+	//! port_names() returns, where the position of each name is its index
+	//! for plugin::port_at(). Return nullptr if the plugin does not
+	//! implement plugin::port_at().
+	//! The table must stay valid as long as the descriptor lives.
+	virtual const char* const* port_table() const { return nullptr; }
+
 	//! csv-list of files that can be loaded, e.g. "xmz, xiz"
 	virtual const char* save_formats() const { return nullptr; }
 
 	virtual bool save_has() const { return false; }
 	virtual bool load_has() const { return false; }
 	virtual bool restore_has() const { return false; }
+	//! return whether the plugin implements plugin::restore_changed()
+	//! (otherwise, it falls back to plugin::restore())
+	virtual bool restore_changed_has() const { return false; }
+	//! return whether the plugin implements plugin::snapshot_save() and
+	//! plugin::snapshot_load()
+	virtual bool snapshot_has() const { return false; }
+
+	//! return whether the plugin implements run_batch()
+	virtual bool run_batch_has() const { return false; }
+
+	//! Run all @p count instances in @p plugins once, with the same
+	//! effect as calling plugin::run() on each of them. All instances
+	//! must have been created by instantiate() of this descriptor and
+	//! must be independent of each other (no instance reads an output of
+	//! another one). Plugins can use this to keep the state of all
+	//! instances in one structure of arrays and to vectorize across
+	//! instances. Hosts may always call this, the default implementation
+	//! just runs the instances one by one.
+	virtual void run_batch(plugin* const* plugins, unsigned count) const {
+		for(unsigned i = 0; i < count; ++i)
+			plugins[i]->run();
+	}
 
 	//! return whether the plugin has an external UI
 	virtual bool ui_ext() const { return false; }
@@ -798,6 +1053,9 @@ public:
 		unsigned realtime_dependency:1;
 		//! plugin makes no syscalls and uses no "slow algorithms"
 		unsigned hard_rt_capable:1;
+		//! plugin relies on IEEE subnormal floats, so hosts must not
+		//! flush them to zero (see audio::denormal_guard)
+		unsigned needs_subnormals:1;
 	} properties;
 };
 
@@ -29,6 +29,8 @@ namespace spa
 	class out_of_range_error;
 
 	class simple_str;
+	class port_bitset;
+	template<unsigned N> class port_bits;
 	class port_ref_base;
 
 	template<class T> class port_ref;
@@ -20,15 +20,29 @@ namespace stereo {
 	ACCEPT_SPA_AUDIO(out)
 }
 
+namespace bus {
+	ACCEPT_SPA_AUDIO(in)
+	ACCEPT_SPA_AUDIO(out)
+}
+
+namespace flat {
+	ACCEPT_SPA_AUDIO(in)
+	ACCEPT_SPA_AUDIO(out)
+}
+
 ACCEPT_SPA_AUDIO(in)
 ACCEPT_SPA_AUDIO(out)
 
 ACCEPT_SPA_AUDIO(samplerate)
 ACCEPT_SPA_AUDIO(buffersize)
 ACCEPT_SPA_AUDIO(samplecount)
+ACCEPT_SPA_AUDIO(tail)
 
 ACCEPT_SPA_AUDIO(osc_ringbuffer_in)
 
+ACCEPT_SPA_AUDIO(event_in)
+ACCEPT_SPA_AUDIO(event_out)
+
 #undef ACCEPT_SPA_AUDIO
 
 } // namespace audio
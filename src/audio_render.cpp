@@ -0,0 +1,261 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "spa/audio_render.h"
+
+namespace spa {
+namespace audio {
+
+/*
+	file_writer
+*/
+
+file_writer::file_writer(const char* path, format_t format,
+	unsigned channels, unsigned long samplerate,
+	std::size_t block_frames) :
+	file(std::fopen(path, "wb")),
+	format(format),
+	channels(channels),
+	samplerate(samplerate)
+{
+	if(!file)
+		throw std::runtime_error("can not open output file");
+	if(format == format_t::wav)
+		write_header();
+	buffers[0].resize(block_frames * channels);
+	buffers[1].resize(block_frames * channels);
+	writer = std::thread(&file_writer::writer_main, this);
+}
+
+file_writer::~file_writer() { close(); }
+
+file_writer::format_t file_writer::format_of(const char* path)
+{
+	const std::string p = path;
+	return (p.size() >= 4 && p.compare(p.size() - 4, 4, ".wav") == 0)
+		? format_t::wav : format_t::raw;
+}
+
+namespace {
+
+void put_le(std::FILE* f, uint32_t value, unsigned bytes)
+{
+	for(unsigned i = 0; i < bytes; ++i, value >>= 8)
+		std::fputc(static_cast<int>(value & 0xff), f);
+}
+
+}
+
+void file_writer::write_header()
+{
+	// sizes are patched in close()
+	std::fwrite("RIFF", 1, 4, file);
+	put_le(file, 0, 4);
+	std::fwrite("WAVEfmt ", 1, 8, file);
+	put_le(file, 16, 4);
+	put_le(file, 3, 2); // IEEE float
+	put_le(file, channels, 2);
+	put_le(file, static_cast<uint32_t>(samplerate), 4);
+	put_le(file, static_cast<uint32_t>(samplerate * channels * 4), 4);
+	put_le(file, channels * 4, 2);
+	put_le(file, 32, 2);
+	std::fwrite("data", 1, 4, file);
+	put_le(file, 0, 4);
+}
+
+void file_writer::write(const float* const* chans, std::size_t frames)
+{
+	std::size_t done = 0;
+	while(done < frames)
+	{
+		std::vector<float>& buf = buffers[current];
+		std::size_t& pos = used[current];
+		const std::size_t n = std::min(frames - done,
+			(buf.size() - pos) / channels);
+		float* dst = buf.data() + pos;
+		for(std::size_t i = 0; i < n; ++i)
+			for(unsigned c = 0; c < channels; ++c)
+				*dst++ = chans[c][done + i];
+		pos += n * channels;
+		done += n;
+		if(pos == buf.size())
+			submit();
+	}
+	total_frames += frames;
+}
+
+void file_writer::submit()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	full[current] = true;
+	cv.notify_all();
+	current ^= 1;
+	// only blocks if the disk is slower than rendering
+	cv.wait(lock, [this]{ return !full[current]; });
+	used[current] = 0;
+}
+
+void file_writer::writer_main()
+{
+	unsigned idx = 0;
+	for(;;)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&]{ return full[idx] || quit; });
+		if(!full[idx])
+			break; // quit, and nothing left to write
+		lock.unlock();
+
+		const std::size_t n = used[idx];
+		if(std::fwrite(buffers[idx].data(), sizeof(float), n, file)
+			!= n)
+			failed = true;
+
+		lock.lock();
+		full[idx] = false;
+		cv.notify_all();
+		idx ^= 1;
+	}
+}
+
+bool file_writer::close()
+{
+	if(!file)
+		return !failed;
+	if(used[current])
+		submit();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	writer.join();
+
+	if(format == format_t::wav)
+	{
+		// the sizes are limited to 32 bit
+		const unsigned long long data_bytes =
+			total_frames * channels * sizeof(float);
+		const uint32_t data32 = (data_bytes > 0xffffffffull - 36)
+			? 0xffffffffu - 36 : static_cast<uint32_t>(data_bytes);
+		failed = failed || std::fseek(file, 4, SEEK_SET);
+		put_le(file, data32 + 36, 4);
+		failed = failed || std::fseek(file, 40, SEEK_SET);
+		put_le(file, data32, 4);
+	}
+	failed = (std::fclose(file) != 0) || failed;
+	file = nullptr;
+	return !failed;
+}
+
+/*
+	automation
+*/
+
+void automation::add(unsigned long long frame, const char* path,
+	const char* types, const pseudo_rtosc::rtosc_arg_t* args)
+{
+	message msg;
+	msg.frame = frame;
+	msg.data.resize(pseudo_rtosc::rtosc_amessage(nullptr, 0, path,
+		types, args));
+	pseudo_rtosc::rtosc_amessage(msg.data.data(), msg.data.size(), path,
+		types, args);
+	// keep the order of messages with equal frames
+	messages.insert(std::upper_bound(messages.begin(), messages.end(),
+		frame, [](unsigned long long f, const message& m) {
+			return f < m.frame; }), std::move(msg));
+}
+
+void automation::load(const char* path)
+{
+	std::ifstream in(path);
+	if(!in)
+		throw std::runtime_error("can not open automation file");
+
+	std::string line;
+	for(unsigned lineno = 1; std::getline(in, line); ++lineno)
+	{
+		std::istringstream ss(line);
+		unsigned long long frame;
+		std::string osc_path, types;
+		ss >> std::ws;
+		if(ss.eof() || ss.peek() == '#')
+			continue; // empty line or comment
+		bool ok = static_cast<bool>(ss >> frame >> osc_path);
+		// messages without arguments may omit the types
+		if(ok && !(ss >> types))
+			types.clear();
+
+		std::vector<pseudo_rtosc::rtosc_arg_t> args(types.size());
+		std::vector<std::string> strings(types.size());
+		for(std::size_t i = 0; ok && i < types.size(); ++i)
+		{
+			switch(types[i])
+			{
+				case 'i': ok = !!(ss >> args[i].i); break;
+				case 'h': ok = !!(ss >> args[i].h); break;
+				case 'f': ok = !!(ss >> args[i].f); break;
+				case 'd': ok = !!(ss >> args[i].d); break;
+				case 's':
+					ok = !!(ss >> strings[i]);
+					args[i].s = strings[i].c_str();
+					break;
+				case 'T': case 'F': case 'N': case 'I': break;
+				default: ok = false;
+			}
+		}
+		if(!ok)
+			throw std::runtime_error("syntax error in automation "
+				"file, line " + std::to_string(lineno));
+		add(frame, osc_path.c_str(), types.c_str(), args.data());
+	}
+}
+
+void automation::splits(unsigned long long first, unsigned frames,
+	std::vector<unsigned>& res) const
+{
+	auto itr = std::upper_bound(messages.begin(), messages.end(), first,
+		[](unsigned long long f, const message& m) {
+			return f < m.frame; });
+	for(; itr != messages.end() && itr->frame < first + frames; ++itr)
+	{
+		const unsigned split =
+			static_cast<unsigned>(itr->frame - first);
+		if(res.empty() || res.back() != split)
+			res.push_back(split);
+	}
+}
+
+void automation::send(osc_ringbuffer& rb, unsigned long long end)
+{
+	for(; next < messages.size() && messages[next].frame < end; ++next)
+		rb.write_with_length(messages[next].data.data(),
+			messages[next].data.size());
+}
+
+} // namespace audio
+} // namespace spa
@@ -0,0 +1,340 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include "spa/audio_host.h"
+#include "spa/graph.h"
+
+namespace spa {
+
+namespace {
+
+//! tell the CPU that we are spinning
+inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+}
+
+graph::node_id graph::add(plugin& plug, bool needs_subnormals)
+{
+	if(started)
+		throw exception("can not add nodes to a running graph");
+	plugins.push_back(&plug);
+	flush.push_back(!needs_subnormals);
+	return static_cast<node_id>(plugins.size() - 1);
+}
+
+void graph::connect(node_id from, node_id to)
+{
+	if(started)
+		throw exception("can not connect nodes of a running graph");
+	if(from >= plugins.size() || to >= plugins.size())
+		throw out_of_range(std::max(from, to), plugins.size());
+	edges.emplace_back(from, to);
+}
+
+std::vector<graph::node_id> graph::predecessors(node_id node) const
+{
+	std::vector<node_id> res;
+	for(const std::pair<node_id, node_id>& e : edges)
+		if(e.second == node)
+			res.push_back(e.first);
+	return res;
+}
+
+std::vector<graph::node_id> graph::successors(node_id node) const
+{
+	std::vector<node_id> res;
+	for(const std::pair<node_id, node_id>& e : edges)
+		if(e.first == node)
+			res.push_back(e.second);
+	return res;
+}
+
+std::vector<graph::node_id> graph::topological_order() const
+{
+	const std::size_t n = plugins.size();
+	std::vector<unsigned> deps(n, 0);
+	std::vector<std::vector<node_id>> out(n);
+	for(const std::pair<node_id, node_id>& e : edges)
+	{
+		++deps[e.second];
+		out[e.first].push_back(e.second);
+	}
+
+	std::vector<node_id> order;
+	order.reserve(n);
+	for(node_id i = 0; i < n; ++i)
+		if(!deps[i])
+			order.push_back(i);
+	for(std::size_t i = 0; i < order.size(); ++i)
+		for(node_id s : out[order[i]])
+			if(!--deps[s])
+				order.push_back(s);
+
+	if(order.size() != n)
+		throw exception("plugin graph contains a cycle");
+	return order;
+}
+
+void graph::compile()
+{
+	const std::size_t n = plugins.size();
+	topological_order(); // check for cycles
+
+	n_deps.assign(n, 0);
+	succ_begin.assign(n + 1, 0);
+	for(const std::pair<node_id, node_id>& e : edges)
+	{
+		++n_deps[e.second];
+		++succ_begin[e.first + 1];
+	}
+	for(std::size_t i = 0; i < n; ++i)
+		succ_begin[i + 1] += succ_begin[i];
+	succ.resize(edges.size());
+	std::vector<unsigned> fill(succ_begin.begin(), succ_begin.end() - 1);
+	for(const std::pair<node_id, node_id>& e : edges)
+		succ[fill[e.first]++] = e.second;
+
+	roots.clear();
+	for(node_id i = 0; i < n; ++i)
+		if(!n_deps[i])
+			roots.push_back(i);
+
+	pending.reset(new std::atomic<unsigned>[n]);
+
+	// each node is pushed once per period, so no deque can overflow
+	std::size_t capacity = 2;
+	for(; capacity < n; capacity *= 2) ;
+	deques.reset(new detail::work_deque[n_threads]);
+	for(unsigned i = 0; i < n_threads; ++i)
+		deques[i].reserve(capacity);
+}
+
+void graph::start(unsigned n_workers)
+{
+	if(started)
+		return;
+	n_threads = n_workers + 1;
+	compile();
+
+	remaining.store(0);
+	quit.store(false);
+	wakeup.reset(new detail::semaphore);
+	for(unsigned i = 1; i < n_threads; ++i)
+		workers.emplace_back(&graph::worker_main, this, i);
+	started = true;
+}
+
+void graph::stop()
+{
+	if(!started)
+		return;
+	quit.store(true);
+	for(std::size_t i = 0; i < workers.size(); ++i)
+		wakeup->post();
+	for(std::thread& t : workers)
+		t.join();
+	workers.clear();
+	wakeup.reset();
+	started = false;
+}
+
+graph::~graph() { stop(); }
+
+void graph::process()
+{
+	const std::size_t n = plugins.size();
+	if(!n)
+		return;
+
+	for(std::size_t i = 0; i < n; ++i)
+		pending[i].store(n_deps[i], std::memory_order_relaxed);
+	remaining.store(static_cast<unsigned>(n), std::memory_order_relaxed);
+	for(node_id r : roots)
+		deques[0].push(r);
+
+	for(std::size_t i = 0; i < workers.size(); ++i)
+		wakeup->post();
+	work(0);
+}
+
+void graph::worker_main(unsigned self)
+{
+	for(;;)
+	{
+		wakeup->wait();
+		if(quit.load())
+			break;
+		work(self);
+	}
+}
+
+void graph::work(unsigned self)
+{
+	detail::work_deque& own = deques[self];
+	node_id node;
+	while(remaining.load(std::memory_order_acquire))
+	{
+		if(own.pop(node) || steal(self, node))
+			execute(self, node);
+		else
+			cpu_relax();
+	}
+}
+
+bool graph::steal(unsigned self, node_id& node)
+{
+	for(unsigned i = 1; i < n_threads; ++i)
+		if(deques[(self + i) % n_threads].steal(node))
+			return true;
+	return false;
+}
+
+void graph::execute(unsigned self, node_id node)
+{
+	{
+		// the FPU mode is per thread, so set it for each node
+		audio::denormal_guard guard(flush[node]);
+		plugins[node]->run();
+	}
+	// make successors available before this node counts as finished
+	for(unsigned i = succ_begin[node]; i < succ_begin[node + 1]; ++i)
+		if(pending[succ[i]].fetch_sub(1,
+			std::memory_order_acq_rel) == 1)
+			deques[self].push(succ[i]);
+	remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+/*
+	buffer_plan
+*/
+
+buffer_plan::signal_id buffer_plan::add_signal(graph::node_id writer)
+{
+	signals.push_back(signal { writer, {}, no_signal, false });
+	return static_cast<signal_id>(signals.size() - 1);
+}
+
+void buffer_plan::add_reader(signal_id sig, graph::node_id reader) {
+	signals.at(sig).readers.push_back(reader); }
+
+void buffer_plan::allow_in_place(signal_id out, signal_id in)
+{
+	signals.at(in);
+	signals.at(out).in_place_of = in;
+}
+
+void buffer_plan::keep(signal_id sig) { signals.at(sig).kept = true; }
+
+unsigned buffer_plan::plan(const graph& g)
+{
+	const std::size_t n = g.size();
+	for(const signal& sig : signals)
+	{
+		if(sig.writer >= n)
+			throw out_of_range(sig.writer, n);
+		for(graph::node_id r : sig.readers)
+			if(r >= n)
+				throw out_of_range(r, n);
+	}
+
+	// strict ancestors of each node, as bitsets
+	const std::vector<graph::node_id> order = g.topological_order();
+	std::vector<unsigned> rank(n);
+	for(std::size_t i = 0; i < n; ++i)
+		rank[order[i]] = static_cast<unsigned>(i);
+	const std::size_t words = (n + 63) / 64;
+	std::vector<uint64_t> anc(n * words, 0);
+	for(graph::node_id v : order)
+		for(graph::node_id p : g.predecessors(v))
+		{
+			for(std::size_t w = 0; w < words; ++w)
+				anc[v * words + w] |= anc[p * words + w];
+			anc[v * words + p / 64] |= uint64_t(1) << (p % 64);
+		}
+	auto is_ancestor = [&](graph::node_id a, graph::node_id b) {
+		return (anc[b * words + a / 64] >> (a % 64)) & 1; };
+	// whether all users of @p sig have finished when @p node starts
+	auto finished_before = [&](const signal& sig, graph::node_id node) {
+		if(sig.kept || !is_ancestor(sig.writer, node))
+			return false;
+		for(graph::node_id r : sig.readers)
+			if(!is_ancestor(r, node))
+				return false;
+		return true;
+	};
+
+	std::vector<signal_id> by_writer(signals.size());
+	std::iota(by_writer.begin(), by_writer.end(), 0);
+	std::stable_sort(by_writer.begin(), by_writer.end(),
+		[&](signal_id s1, signal_id s2) {
+			return rank[signals[s1].writer] <
+				rank[signals[s2].writer]; });
+
+	const unsigned no_buffer = static_cast<unsigned>(-1);
+	buffer.assign(signals.size(), no_buffer);
+	std::vector<signal_id> occupant; // current signal of each buffer
+	for(signal_id s : by_writer)
+	{
+		const signal& sig = signals[s];
+		if(sig.in_place_of != no_signal)
+		{
+			// the writer may overwrite its input if all other
+			// readers of the input have finished
+			const signal& in = signals[sig.in_place_of];
+			const unsigned b = buffer[sig.in_place_of];
+			bool ok = !in.kept && b != no_buffer &&
+				occupant[b] == sig.in_place_of &&
+				is_ancestor(in.writer, sig.writer);
+			for(graph::node_id r : in.readers)
+				ok = ok && (r == sig.writer ||
+					is_ancestor(r, sig.writer));
+			if(ok)
+			{
+				buffer[s] = b;
+				occupant[b] = s;
+				continue;
+			}
+		}
+
+		unsigned b = 0;
+		for(; b < occupant.size() && !finished_before(
+			signals[occupant[b]], sig.writer); ++b) ;
+		if(b == occupant.size())
+			occupant.push_back(s);
+		else
+			occupant[b] = s;
+		buffer[s] = b;
+	}
+
+	n_buffers = static_cast<unsigned>(occupant.size());
+	return n_buffers;
+}
+
+}
@@ -0,0 +1,510 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "spa/host.h"
+
+namespace spa {
+
+state_worker::state_worker(const descriptor& desc, plugin& running,
+	factory_t factory, disposer_t disposer,
+	std::chrono::milliseconds timeout) :
+	desc(desc),
+	factory(std::move(factory)),
+	disposer(std::move(disposer)),
+	timeout(timeout),
+	current(&running),
+	ready(nullptr),
+	retired(nullptr),
+	save_state(save_idle),
+	worker(&state_worker::worker_main, this)
+{
+}
+
+state_worker::~state_worker()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	worker.join();
+}
+
+plugin& state_worker::acquire()
+{
+	plugin* loaded = ready.load(std::memory_order_acquire);
+	// the worker may take it back on timeout, so this must be atomic
+	if(loaded && ready.compare_exchange_strong(loaded, nullptr,
+		std::memory_order_acq_rel))
+	{
+		retired.store(current, std::memory_order_release);
+		current = loaded;
+	}
+
+	int state = save_state.load(std::memory_order_acquire);
+	// the worker may cancel the request on timeout, so claim it first
+	if(state == save_requested &&
+		save_state.compare_exchange_strong(state, save_busy,
+			std::memory_order_acq_rel))
+	{
+		save_size = current->snapshot_save(save_buffer, save_capacity);
+		save_state.store(save_captured, std::memory_order_release);
+	}
+	return *current;
+}
+
+uint64_t state_worker::enqueue(kind_t kind, const std::string& savefile)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const uint64_t ticket = next_ticket++;
+	jobs.push_back(job { kind, savefile, ticket });
+	results[ticket] = status_t::pending;
+	cv.notify_all();
+	return ticket;
+}
+
+uint64_t state_worker::load(const std::string& savefile) {
+	return enqueue(kind_t::load, savefile); }
+
+uint64_t state_worker::save(const std::string& savefile) {
+	return enqueue(kind_t::save, savefile); }
+
+state_worker::status_t state_worker::status(uint64_t ticket) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto itr = results.find(ticket);
+	return (itr == results.end()) ? status_t::unknown : itr->second;
+}
+
+state_worker::status_t state_worker::wait(uint64_t ticket) const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto itr = results.find(ticket);
+	if(itr == results.end())
+		return status_t::unknown;
+	cv.wait(lock, [&]{ return itr->second != status_t::pending || quit; });
+	return itr->second;
+}
+
+bool state_worker::poll(const std::function<bool()>& done)
+{
+	const std::chrono::steady_clock::time_point end =
+		std::chrono::steady_clock::now() + timeout;
+	for(;;)
+	{
+		if(done())
+			return true;
+		std::unique_lock<std::mutex> lock(mutex);
+		if(quit || std::chrono::steady_clock::now() >= end)
+			return false;
+		cv.wait_for(lock, std::chrono::milliseconds(1));
+	}
+}
+
+bool state_worker::run_load(const job& j)
+{
+	if(!desc.load_has())
+		return false;
+	plugin* fresh = factory();
+	if(!fresh)
+		return false;
+	const char* file = j.savefile.c_str();
+	if(!fresh->load(file, j.ticket) ||
+		!poll([&]{ return fresh->load_check(file, j.ticket); }))
+	{
+		disposer(fresh);
+		return false;
+	}
+
+	// swap at the next block boundary, then dispose the old instance
+	ready.store(fresh, std::memory_order_release);
+	if(!poll([&]{ return retired.load(std::memory_order_acquire); }))
+	{
+		// the audio thread did not take it, e.g. because it stopped
+		plugin* not_taken = fresh;
+		if(ready.compare_exchange_strong(not_taken, nullptr))
+		{
+			disposer(fresh);
+			return false;
+		}
+		// it has just been taken
+		while(!retired.load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+	disposer(retired.exchange(nullptr, std::memory_order_acq_rel));
+	return true;
+}
+
+bool state_worker::capture(void* buffer, std::size_t capacity)
+{
+	save_buffer = buffer;
+	save_capacity = capacity;
+	save_state.store(save_requested, std::memory_order_release);
+	poll([&]{ return save_state.load(std::memory_order_acquire) ==
+		save_captured; });
+
+	// on timeout, cancel the request, unless the audio thread is using it
+	int state;
+	for(;;)
+	{
+		state = save_state.load(std::memory_order_acquire);
+		if(state == save_captured)
+			break;
+		if(state != save_busy && save_state.compare_exchange_strong(
+			state, save_canceled, std::memory_order_acq_rel))
+			break;
+		std::this_thread::yield();
+	}
+	save_state.store(save_idle, std::memory_order_release);
+	return state == save_captured;
+}
+
+bool state_worker::run_save(const job& j)
+{
+	if(!desc.save_has() || !desc.snapshot_has())
+		return false;
+
+	// grow the buffer until the state fits
+	std::vector<uint64_t> buffer(512); // uint64_t for the alignment
+	for(;;)
+	{
+		const std::size_t capacity = buffer.size() * sizeof(uint64_t);
+		if(!capture(buffer.data(), capacity) || !save_size)
+			return false;
+		if(save_size <= capacity)
+			break;
+		buffer.resize((save_size + sizeof(uint64_t) - 1) /
+			sizeof(uint64_t));
+	}
+
+	// save from an instance that the audio thread does not run
+	plugin* clone = factory();
+	if(!clone)
+		return false;
+	const char* file = j.savefile.c_str();
+	const bool ok = clone->snapshot_load(buffer.data(), save_size) &&
+		clone->save(file, j.ticket) &&
+		poll([&]{ return clone->save_check(file, j.ticket); });
+	disposer(clone);
+	return ok;
+}
+
+void state_worker::worker_main()
+{
+	for(;;)
+	{
+		job j;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]{ return quit || !jobs.empty(); });
+			if(quit)
+				break;
+			j = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		const bool ok = (j.kind == kind_t::load) ? run_load(j)
+			: run_save(j);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		results[j.ticket] = ok ? status_t::done : status_t::failed;
+		cv.notify_all();
+	}
+}
+
+/*
+	instance pool
+*/
+
+instance_pool::instance_pool(factory_t factory, disposer_t disposer,
+	std::size_t instance_bytes, std::size_t memory_budget,
+	unsigned min_size, std::chrono::seconds decay) :
+	factory(std::move(factory)),
+	disposer(std::move(disposer)),
+	max_size(static_cast<unsigned>(std::min<std::size_t>(
+		memory_budget / std::max<std::size_t>(instance_bytes, 1),
+		std::numeric_limits<unsigned>::max()))),
+	min_size(std::min(min_size, max_size)),
+	decay(decay),
+	target(this->min_size),
+	last_use(std::chrono::steady_clock::now()),
+	worker(&instance_pool::worker_main, this)
+{
+}
+
+instance_pool::~instance_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	worker.join();
+	for(plugin* p : ready)
+		disposer(p);
+}
+
+plugin* instance_pool::take()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	last_use = std::chrono::steady_clock::now();
+	plugin* res = nullptr;
+	if(ready.empty())
+	{
+		// demand is higher than expected
+		target = std::min(std::max(2 * target, 1u), max_size);
+	}
+	else
+	{
+		res = ready.back();
+		ready.pop_back();
+		if(ready.empty())
+			target = std::min(target + 1, max_size);
+	}
+	cv.notify_all();
+	return res;
+}
+
+std::size_t instance_pool::available() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ready.size();
+}
+
+unsigned instance_pool::target_size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return target;
+}
+
+void instance_pool::worker_main()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!quit)
+	{
+		if(target > min_size && std::chrono::steady_clock::now()
+			- last_use >= decay)
+		{
+			--target;
+			last_use = std::chrono::steady_clock::now();
+		}
+
+		if(ready.size() < target)
+		{
+			// instantiate without holding the lock
+			lock.unlock();
+			plugin* fresh = nullptr;
+			try {
+				fresh = factory();
+			} catch(...) {}
+			lock.lock();
+			if(fresh)
+			{
+				ready.push_back(fresh);
+				continue;
+			}
+			// failed, try again later
+		}
+		else if(ready.size() > target)
+		{
+			plugin* spare = ready.back();
+			ready.pop_back();
+			lock.unlock();
+			disposer(spare);
+			lock.lock();
+			continue;
+		}
+		cv.wait_for(lock, std::chrono::seconds(1));
+	}
+}
+
+/*
+	run() timing
+*/
+
+run_stats::run_stats(long samplerate) :
+	samplerate(samplerate),
+	n_calls(0), n_frames(0), sum_ns(0), max_ns(0), peak_ppm(0)
+{
+	for(std::atomic<uint64_t>& count : histogram)
+		count.store(0, std::memory_order_relaxed);
+}
+
+run_stats::totals run_stats::read() const
+{
+	totals res;
+	res.samplerate = samplerate;
+	res.calls = n_calls.load(std::memory_order_relaxed);
+	res.frames = n_frames.load(std::memory_order_relaxed);
+	res.ns = sum_ns.load(std::memory_order_relaxed);
+	res.max_ns = max_ns.load(std::memory_order_relaxed);
+	res.peak_load_ppm = peak_ppm.load(std::memory_order_relaxed);
+	for(unsigned i = 0; i < n_buckets; ++i)
+		res.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+	return res;
+}
+
+double run_stats::totals::load() const
+{
+	// ns / (frames / samplerate * 1e9) * 100
+	return frames ? static_cast<double>(ns) * samplerate
+		/ (static_cast<double>(frames) * 1e7) : 0.;
+}
+
+run_stats::totals run_stats::totals::since(const totals& earlier) const
+{
+	totals res = *this;
+	res.calls -= earlier.calls;
+	res.frames -= earlier.frames;
+	res.ns -= earlier.ns;
+	for(unsigned i = 0; i < n_buckets; ++i)
+		res.histogram[i] -= earlier.histogram[i];
+	return res;
+}
+
+/*
+	snapshots
+*/
+
+namespace {
+
+constexpr const char snapshot_magic[8] = "spasnap";
+
+std::size_t align8(std::size_t size) { return (size + 7) & ~std::size_t(7); }
+
+//! whether [@p offset, @p offset + @p size) is an aligned section behind
+//! the header of @p h, without overflowing
+bool section_ok(const snapshot_header& h, uint64_t offset, uint64_t size)
+{
+	return !(offset % 8) && offset >= h.header_size &&
+		offset <= h.total_size && size <= h.total_size - offset;
+}
+
+}
+
+snapshot_view::snapshot_view(const void* data, std::size_t size)
+{
+	const snapshot_header* h = static_cast<const snapshot_header*>(data);
+	if(!(reinterpret_cast<uintptr_t>(data) % 8) &&
+		size >= sizeof(snapshot_header) &&
+		!std::memcmp(h->magic, snapshot_magic, sizeof(h->magic)) &&
+		h->version == snapshot_version &&
+		h->header_size == sizeof(snapshot_header) &&
+		h->total_size <= size &&
+		section_ok(*h, h->controls_offset, h->controls_size) &&
+		section_ok(*h, h->state_offset, h->state_size))
+		header = h;
+}
+
+bool snapshot_view::restore(plugin& plug, void* controls,
+	std::size_t control_bytes) const
+{
+	if(!header || control_bytes != controls_size())
+		return false;
+	if(state_size() && !plug.snapshot_load(state(), state_size()))
+		return false;
+	if(control_bytes)
+		std::memcpy(controls, this->controls(), control_bytes);
+	return true;
+}
+
+int snapshot_view::restore_controls(void* controls,
+	std::size_t control_bytes, const control_slot* slots,
+	std::size_t n_slots, port_bitset* changed) const
+{
+	if(!header || control_bytes != controls_size())
+		return -1;
+	int n_changed = 0;
+	char* dst = static_cast<char*>(controls);
+	const char* src = static_cast<const char*>(this->controls());
+	for(std::size_t i = 0; i < n_slots; ++i)
+	{
+		const control_slot& slot = slots[i];
+		if(slot.offset > control_bytes ||
+			slot.size > control_bytes - slot.offset)
+			continue;
+		if(std::memcmp(dst + slot.offset, src + slot.offset, slot.size))
+		{
+			std::memcpy(dst + slot.offset, src + slot.offset,
+				slot.size);
+			if(changed && slot.port < changed->size())
+				changed->set(slot.port);
+			++n_changed;
+		}
+	}
+	return n_changed;
+}
+
+bool snapshot_view::restore(plugin& plug, void* controls,
+	std::size_t control_bytes, const control_slot* slots,
+	std::size_t n_slots, port_bitset& changed, uint64_t ticket) const
+{
+	if(!header || control_bytes != controls_size())
+		return false;
+	if(state_size() && !plug.snapshot_load(state(), state_size()))
+		return false;
+	changed.clear();
+	restore_controls(controls, control_bytes, slots, n_slots, &changed);
+	plug.restore_changed(ticket, changed.any() ? &changed : nullptr,
+		nullptr);
+	return true;
+}
+
+void snapshot::capture(plugin& plug, const void* controls,
+	std::size_t control_bytes)
+{
+	const std::size_t controls_offset = align8(sizeof(snapshot_header)),
+		state_offset = controls_offset + align8(control_bytes);
+	std::size_t state_size = plug.snapshot_save(nullptr, 0);
+	for(;;)
+	{
+		storage.assign(align8(state_offset + state_size) / 8, 0);
+		char* bytes = reinterpret_cast<char*>(storage.data());
+		const std::size_t needed = state_size
+			? plug.snapshot_save(bytes + state_offset, state_size)
+			: 0;
+		if(needed <= state_size)
+		{
+			state_size = needed;
+			break;
+		}
+		state_size = needed; // the state has grown meanwhile
+	}
+
+	snapshot_header& h = *reinterpret_cast<snapshot_header*>(
+		storage.data());
+	std::memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+	h.version = snapshot_version;
+	h.header_size = sizeof(snapshot_header);
+	h.total_size = size();
+	h.controls_offset = controls_offset;
+	h.controls_size = control_bytes;
+	h.state_offset = state_offset;
+	h.state_size = state_size;
+	if(control_bytes)
+		std::memcpy(reinterpret_cast<char*>(storage.data())
+			+ controls_offset, controls, control_bytes);
+}
+
+}
@@ -0,0 +1,510 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file rtcheck.cpp
+	the RT-safety checker, an LD_PRELOAD library (see rtcheck.h)
+
+	Allocations are forwarded to glibc's __libc_* functions, all other
+	functions to the next definition. Those are looked up when the library
+	is loaded (or on their first use, if that is earlier), so no lookup
+	happens inside a checked scope.
+*/
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace {
+
+thread_local unsigned depth = 0;       //!< nesting of rt scopes
+thread_local const char* scope_name = nullptr;
+thread_local bool reporting = false;   //!< no reports while reporting
+std::atomic<unsigned long> violations(0);
+bool abort_on_violation = false;
+std::size_t page_size = 4096;          //!< for valloc() and pvalloc()
+
+void report(const char* function)
+{
+	if(!depth || reporting)
+		return;
+	reporting = true;
+	++violations;
+	std::fprintf(stderr, "rtcheck: %s() called in realtime scope \"%s\"\n",
+		function, scope_name ? scope_name : "");
+	void* frames[64];
+	// skip this function
+	const int n = backtrace(frames, 64);
+	if(n > 1)
+		backtrace_symbols_fd(frames + 1, n - 1, STDERR_FILENO);
+	if(abort_on_violation)
+		std::abort();
+	reporting = false;
+}
+
+template<class F>
+F next(F& fptr, const char* name)
+{
+	if(!fptr)
+		fptr = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+	return fptr;
+}
+
+int (*next_mutex_lock)(pthread_mutex_t*);
+int (*next_cond_wait)(pthread_cond_t*, pthread_mutex_t*);
+int (*next_cond_timedwait)(pthread_cond_t*, pthread_mutex_t*,
+	const struct timespec*);
+int (*next_sem_wait)(sem_t*);
+ssize_t (*next_read)(int, void*, size_t);
+ssize_t (*next_write)(int, const void*, size_t);
+int (*next_open)(const char*, int, ...);
+int (*next_open64)(const char*, int, ...);
+int (*next_openat)(int, const char*, int, ...);
+int (*next_openat64)(int, const char*, int, ...);
+int (*next_close)(int);
+FILE* (*next_fopen)(const char*, const char*);
+FILE* (*next_fopen64)(const char*, const char*);
+int (*next_fclose)(FILE*);
+size_t (*next_fread)(void*, size_t, size_t, FILE*);
+size_t (*next_fwrite)(const void*, size_t, size_t, FILE*);
+int (*next_fputs)(const char*, FILE*);
+int (*next_puts)(const char*);
+int (*next_fputc)(int, FILE*);
+int (*next_putc)(int, FILE*);
+int (*next_fflush)(FILE*);
+int (*next_vfprintf)(FILE*, const char*, va_list);
+int (*next_nanosleep)(const struct timespec*, struct timespec*);
+int (*next_usleep)(useconds_t);
+
+__attribute__((constructor))
+void init()
+{
+	next(next_mutex_lock, "pthread_mutex_lock");
+	next(next_cond_wait, "pthread_cond_wait");
+	next(next_cond_timedwait, "pthread_cond_timedwait");
+	next(next_sem_wait, "sem_wait");
+	next(next_read, "read");
+	next(next_write, "write");
+	next(next_open, "open");
+	next(next_open64, "open64");
+	next(next_openat, "openat");
+	next(next_openat64, "openat64");
+	next(next_close, "close");
+	next(next_fopen, "fopen");
+	next(next_fopen64, "fopen64");
+	next(next_fclose, "fclose");
+	next(next_fread, "fread");
+	next(next_fwrite, "fwrite");
+	next(next_fputs, "fputs");
+	next(next_puts, "puts");
+	next(next_fputc, "fputc");
+	next(next_putc, "putc");
+	next(next_fflush, "fflush");
+	next(next_vfprintf, "vfprintf");
+	next(next_nanosleep, "nanosleep");
+	next(next_usleep, "usleep");
+	abort_on_violation = std::getenv("SPA_RTCHECK_ABORT");
+	page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	// backtrace() allocates on its first call, so call it here
+	void* frame;
+	backtrace(&frame, 1);
+}
+
+__attribute__((destructor))
+void fini()
+{
+	if(violations)
+		std::fprintf(stderr, "rtcheck: %lu violation(s)\n",
+			violations.load());
+}
+
+//! the mode argument of open(), if @p flags need one
+mode_t open_mode(int flags, va_list args)
+{
+	return (flags & (O_CREAT | O_TMPFILE))
+		? static_cast<mode_t>(va_arg(args, int)) : 0;
+}
+
+void* checked_new(std::size_t size, const char* function)
+{
+	report(function);
+	void* res = __libc_malloc(size ? size : 1);
+	if(!res)
+		throw std::bad_alloc();
+	return res;
+}
+
+#ifdef __cpp_aligned_new
+void* checked_new(std::size_t size, std::align_val_t alignment,
+	const char* function)
+{
+	report(function);
+	void* res = __libc_memalign(static_cast<std::size_t>(alignment),
+		size ? size : 1);
+	if(!res)
+		throw std::bad_alloc();
+	return res;
+}
+#endif
+
+}
+
+/*
+	checked scopes
+*/
+
+extern "C" {
+
+void spa_rtcheck_enter(const char* what)
+{
+	if(!depth++)
+		scope_name = what;
+}
+
+void spa_rtcheck_leave()
+{
+	if(depth)
+		--depth;
+}
+
+unsigned long spa_rtcheck_violations() { return violations.load(); }
+
+}
+
+/*
+	allocation
+*/
+
+extern "C" {
+
+void* malloc(size_t size) { report("malloc"); return __libc_malloc(size); }
+void* calloc(size_t n, size_t size) {
+	report("calloc"); return __libc_calloc(n, size); }
+void* realloc(void* ptr, size_t size) {
+	report("realloc"); return __libc_realloc(ptr, size); }
+void free(void* ptr)
+{
+	if(ptr)
+		report("free");
+	__libc_free(ptr);
+}
+int posix_memalign(void** res, size_t alignment, size_t size)
+{
+	report("posix_memalign");
+	*res = __libc_memalign(alignment, size);
+	return *res ? 0 : ENOMEM;
+}
+void* aligned_alloc(size_t alignment, size_t size) {
+	report("aligned_alloc"); return __libc_memalign(alignment, size); }
+void* memalign(size_t alignment, size_t size) {
+	report("memalign"); return __libc_memalign(alignment, size); }
+void* valloc(size_t size) {
+	report("valloc"); return __libc_memalign(page_size, size); }
+void* pvalloc(size_t size)
+{
+	report("pvalloc");
+	return __libc_memalign(page_size,
+		(size + page_size - 1) / page_size * page_size);
+}
+
+}
+
+void* operator new(std::size_t size) {
+	return checked_new(size, "operator new"); }
+void* operator new[](std::size_t size) {
+	return checked_new(size, "operator new[]"); }
+void* operator new(std::size_t size, const std::nothrow_t& ) noexcept
+{
+	report("operator new");
+	return __libc_malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& ) noexcept
+{
+	report("operator new[]");
+	return __libc_malloc(size ? size : 1);
+}
+void operator delete(void* ptr) noexcept
+{
+	if(ptr)
+		report("operator delete");
+	__libc_free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+	if(ptr)
+		report("operator delete[]");
+	__libc_free(ptr);
+}
+void operator delete(void* ptr, std::size_t ) noexcept {
+	operator delete(ptr); }
+void operator delete[](void* ptr, std::size_t ) noexcept {
+	operator delete[](ptr); }
+
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return checked_new(size, alignment, "operator new"); }
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return checked_new(size, alignment, "operator new[]"); }
+void* operator new(std::size_t size, std::align_val_t alignment,
+	const std::nothrow_t& ) noexcept
+{
+	report("operator new");
+	return __libc_memalign(static_cast<std::size_t>(alignment),
+		size ? size : 1);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment,
+	const std::nothrow_t& ) noexcept
+{
+	report("operator new[]");
+	return __libc_memalign(static_cast<std::size_t>(alignment),
+		size ? size : 1);
+}
+void operator delete(void* ptr, std::align_val_t ) noexcept {
+	operator delete(ptr); }
+void operator delete[](void* ptr, std::align_val_t ) noexcept {
+	operator delete[](ptr); }
+void operator delete(void* ptr, std::size_t , std::align_val_t ) noexcept {
+	operator delete(ptr); }
+void operator delete[](void* ptr, std::size_t , std::align_val_t )
+	noexcept { operator delete[](ptr); }
+#endif
+
+/*
+	locks and syscalls
+*/
+
+extern "C" {
+
+int pthread_mutex_lock(pthread_mutex_t* m)
+{
+	report("pthread_mutex_lock");
+	return next(next_mutex_lock, "pthread_mutex_lock")(m);
+}
+
+int pthread_cond_wait(pthread_cond_t* c, pthread_mutex_t* m)
+{
+	report("pthread_cond_wait");
+	return next(next_cond_wait, "pthread_cond_wait")(c, m);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* c, pthread_mutex_t* m,
+	const struct timespec* t)
+{
+	report("pthread_cond_timedwait");
+	return next(next_cond_timedwait, "pthread_cond_timedwait")(c, m, t);
+}
+
+int sem_wait(sem_t* s)
+{
+	report("sem_wait");
+	return next(next_sem_wait, "sem_wait")(s);
+}
+
+ssize_t read(int fd, void* buf, size_t n)
+{
+	report("read");
+	return next(next_read, "read")(fd, buf, n);
+}
+
+ssize_t write(int fd, const void* buf, size_t n)
+{
+	report("write");
+	return next(next_write, "write")(fd, buf, n);
+}
+
+int open(const char* path, int flags, ...)
+{
+	report("open");
+	va_list args;
+	va_start(args, flags);
+	const mode_t mode = open_mode(flags, args);
+	va_end(args);
+	return next(next_open, "open")(path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...)
+{
+	report("open64");
+	va_list args;
+	va_start(args, flags);
+	const mode_t mode = open_mode(flags, args);
+	va_end(args);
+	return next(next_open64, "open64")(path, flags, mode);
+}
+
+int openat(int dir, const char* path, int flags, ...)
+{
+	report("openat");
+	va_list args;
+	va_start(args, flags);
+	const mode_t mode = open_mode(flags, args);
+	va_end(args);
+	return next(next_openat, "openat")(dir, path, flags, mode);
+}
+
+int openat64(int dir, const char* path, int flags, ...)
+{
+	report("openat64");
+	va_list args;
+	va_start(args, flags);
+	const mode_t mode = open_mode(flags, args);
+	va_end(args);
+	return next(next_openat64, "openat64")(dir, path, flags, mode);
+}
+
+int close(int fd)
+{
+	report("close");
+	return next(next_close, "close")(fd);
+}
+
+}
+
+/*
+	stdio and iostreams, which do not use the functions above
+*/
+
+extern "C" {
+
+FILE* fopen(const char* path, const char* mode)
+{
+	report("fopen");
+	return next(next_fopen, "fopen")(path, mode);
+}
+
+FILE* fopen64(const char* path, const char* mode)
+{
+	report("fopen64");
+	return next(next_fopen64, "fopen64")(path, mode);
+}
+
+int fclose(FILE* f)
+{
+	report("fclose");
+	return next(next_fclose, "fclose")(f);
+}
+
+size_t fread(void* buf, size_t size, size_t n, FILE* f)
+{
+	report("fread");
+	return next(next_fread, "fread")(buf, size, n, f);
+}
+
+size_t fwrite(const void* buf, size_t size, size_t n, FILE* f)
+{
+	report("fwrite");
+	return next(next_fwrite, "fwrite")(buf, size, n, f);
+}
+
+int fputs(const char* str, FILE* f)
+{
+	report("fputs");
+	return next(next_fputs, "fputs")(str, f);
+}
+
+int puts(const char* str)
+{
+	report("puts");
+	return next(next_puts, "puts")(str);
+}
+
+int fputc(int c, FILE* f)
+{
+	report("fputc");
+	return next(next_fputc, "fputc")(c, f);
+}
+
+int putc(int c, FILE* f)
+{
+	report("putc");
+	return next(next_putc, "putc")(c, f);
+}
+
+int fflush(FILE* f)
+{
+	report("fflush");
+	return next(next_fflush, "fflush")(f);
+}
+
+int vfprintf(FILE* f, const char* format, va_list args)
+{
+	report("vfprintf");
+	return next(next_vfprintf, "vfprintf")(f, format, args);
+}
+
+int fprintf(FILE* f, const char* format, ...)
+{
+	report("fprintf");
+	va_list args;
+	va_start(args, format);
+	const int res = next(next_vfprintf, "vfprintf")(f, format, args);
+	va_end(args);
+	return res;
+}
+
+int printf(const char* format, ...)
+{
+	report("printf");
+	va_list args;
+	va_start(args, format);
+	const int res = next(next_vfprintf, "vfprintf")(stdout, format, args);
+	va_end(args);
+	return res;
+}
+
+}
+
+/*
+	sleeping
+*/
+
+extern "C" {
+
+int nanosleep(const struct timespec* t, struct timespec* rem)
+{
+	report("nanosleep");
+	return next(next_nanosleep, "nanosleep")(t, rem);
+}
+
+int usleep(useconds_t us)
+{
+	report("usleep");
+	return next(next_usleep, "usleep")(us);
+}
+
+}
@@ -0,0 +1,110 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file buffer-plan-test.cpp
+	buffer_plan::plan() for chains, in-place chains and diamonds
+*/
+
+#include <memory>
+#include <vector>
+#include <spa/graph.h>
+
+#include "check.h"
+
+class nop_plugin : public spa::plugin
+{
+public:
+	void run() override {}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+};
+
+//! graph with @p n nodes, where the edges are given as pairs
+class test_graph
+{
+	std::vector<std::unique_ptr<nop_plugin>> plugins;
+public:
+	spa::graph g;
+	test_graph(unsigned n,
+		std::vector<std::pair<unsigned, unsigned>> edges)
+	{
+		for(unsigned i = 0; i < n; ++i)
+		{
+			plugins.emplace_back(new nop_plugin);
+			g.add(*plugins.back());
+		}
+		for(const std::pair<unsigned, unsigned>& e : edges)
+			g.connect(e.first, e.second);
+	}
+};
+
+//! 0 -> 1 -> 2, where 2's output is read by the host
+static void test_chain(bool in_place)
+{
+	test_graph t(3, {{0, 1}, {1, 2}});
+	spa::buffer_plan plan;
+	const unsigned s0 = plan.add_signal(0), s1 = plan.add_signal(1),
+		s2 = plan.add_signal(2);
+	plan.add_reader(s0, 1);
+	plan.add_reader(s1, 2);
+	plan.keep(s2);
+	if(in_place)
+	{
+		plan.allow_in_place(s1, s0);
+		plan.allow_in_place(s2, s1);
+	}
+
+	CHECK(plan.plan(t.g) == (in_place ? 1u : 2u));
+	CHECK(plan.buffers() == (in_place ? 1u : 2u));
+	CHECK(plan.buffer_of(s0) != plan.buffer_of(s1) || in_place);
+	CHECK(plan.buffer_of(s1) != plan.buffer_of(s2) || in_place);
+	// s0 is finished when node 2 runs
+	CHECK(plan.buffer_of(s0) == plan.buffer_of(s2));
+}
+
+//! 0 -> {1, 2} -> 3, where 1 and 2 may run in parallel
+static void test_diamond()
+{
+	test_graph t(4, {{0, 1}, {0, 2}, {1, 3}, {2, 3}});
+	spa::buffer_plan plan;
+	const unsigned s0 = plan.add_signal(0), s1 = plan.add_signal(1),
+		s2 = plan.add_signal(2), s3 = plan.add_signal(3);
+	plan.add_reader(s0, 1);
+	plan.add_reader(s0, 2);
+	plan.add_reader(s1, 3);
+	plan.add_reader(s2, 3);
+	plan.keep(s3);
+	// not possible, since node 2 still reads s0 while node 1 runs
+	plan.allow_in_place(s1, s0);
+
+	CHECK(plan.plan(t.g) == 3);
+	CHECK(plan.buffer_of(s0) != plan.buffer_of(s1));
+	CHECK(plan.buffer_of(s0) != plan.buffer_of(s2));
+	CHECK(plan.buffer_of(s1) != plan.buffer_of(s2));
+	CHECK(plan.buffer_of(s3) == plan.buffer_of(s0));
+}
+
+int main()
+{
+	test_chain(false);
+	test_chain(true);
+	test_diamond();
+	return test_result();
+}
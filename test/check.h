@@ -0,0 +1,52 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file check.h
+	minimal checks for the tests, without a test framework
+
+	Each test is a program that runs all its checks and returns
+	test_result() from main().
+*/
+
+#ifndef SPA_TEST_CHECK_H
+#define SPA_TEST_CHECK_H
+
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+int failures = 0;
+
+int test_result() { return failures ? EXIT_FAILURE : EXIT_SUCCESS; }
+
+}
+
+//! report @p cond if it is false, and continue
+#define CHECK(cond) \
+	do { \
+		if(!(cond)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ \
+				<< ": check failed: " #cond << std::endl; \
+			++failures; \
+		} \
+	} while(0)
+
+#endif // SPA_TEST_CHECK_H
@@ -0,0 +1,154 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file convert-test.cpp
+	round trips and clipping of the conversion kernels, for all pairs of
+	sample formats
+*/
+
+#include <cmath>
+#include <limits>
+#include <spa/audio_convert.h>
+
+#include "check.h"
+
+using namespace spa::audio;
+
+template<class T> struct info;
+template<> struct info<float> { static constexpr int bits = 24; };
+template<> struct info<double> { static constexpr int bits = 53; };
+template<> struct info<int16_t> { static constexpr int bits = 16; };
+template<> struct info<int24> { static constexpr int bits = 24; };
+template<> struct info<int32_t> { static constexpr int bits = 32; };
+
+template<class T> bool is_int() { return info<T>::bits != 24 &&
+	info<T>::bits != 53; }
+template<> bool is_int<int24>() { return true; }
+
+template<class T> double real(T s) {
+	return detail::sample_traits<T, double>::to_real(s); }
+template<class T> T sample(double r) {
+	return detail::sample_traits<T, double>::from_real(r); }
+
+const double values[] = { -1., -0.75, -1. / 3., -1e-6, 0., 1e-6, 0.25,
+	0.5, 2. / 3., 0.999 };
+constexpr std::size_t n_values = sizeof(values) / sizeof(values[0]);
+
+template<class S, class D>
+void round_trip()
+{
+	S src[n_values], back[n_values];
+	D dst[n_values];
+	for(std::size_t i = 0; i < n_values; ++i)
+		src[i] = sample<S>(values[i]);
+	convert(src, dst, n_values);
+	convert(dst, back, n_values);
+
+	// exact if D can represent all values of S, else one step of D
+	// (integers have fixed steps, floats relative ones)
+	const bool exact = (is_int<S>() || !is_int<D>()) &&
+		info<D>::bits >= info<S>::bits;
+	const double tol = exact ? 0. : std::ldexp(1., 1 - info<D>::bits);
+	for(std::size_t i = 0; i < n_values; ++i)
+		CHECK(std::fabs(real(back[i]) - real(src[i])) <= tol);
+
+	// the runtime dispatch must give the same result
+	D dst2[n_values];
+	convert(src, sample_format<S>::value, dst2, sample_format<D>::value,
+		n_values);
+	for(std::size_t i = 0; i < n_values; ++i)
+		CHECK(real(dst2[i]) == real(dst[i]));
+}
+
+template<class S, class D>
+void clipping()
+{
+	// full scale with gain 4 must clip integers and pass through floats
+	const S src[2] = { sample<S>(-1.), sample<S>(1. - 1e-12) };
+	D dst[2];
+	convert(src, dst, 2, 4.f);
+	if(is_int<D>())
+	{
+		CHECK(real(dst[0]) == -1.);
+		CHECK(real(dst[1]) < 1. && real(dst[1]) > 0.99);
+		// the full range in 2^(bits-1) steps
+		CHECK(real(dst[1]) == 1. - std::ldexp(1., 1 - info<D>::bits));
+	}
+	else
+	{
+		CHECK(real(dst[0]) == -4.);
+		CHECK(real(dst[1]) > 3.99);
+	}
+
+	// convert_add clips the sum
+	D sum[2] = { sample<D>(-0.75), sample<D>(0.75) };
+	convert_add(src, sum, 2);
+	if(is_int<D>())
+		CHECK(real(sum[0]) == -1. && real(sum[1]) < 1.);
+	else
+		CHECK(real(sum[0]) == -1.75 && real(sum[1]) > 1.74);
+}
+
+template<class S, class D>
+void test_pair()
+{
+	round_trip<S, D>();
+	clipping<S, D>();
+}
+
+template<class S>
+void test_from()
+{
+	test_pair<S, float>();
+	test_pair<S, double>();
+	test_pair<S, int16_t>();
+	test_pair<S, int24>();
+	test_pair<S, int32_t>();
+}
+
+int main()
+{
+	test_from<float>();
+	test_from<double>();
+	test_from<int16_t>();
+	test_from<int24>();
+	test_from<int32_t>();
+
+	// the smallest integer is exactly -1, the largest is clamped
+	CHECK(real(int16_t(-32768)) == -1.);
+	CHECK(sample<int16_t>(1.) == 32767);
+	CHECK(sample<int16_t>(-1.) == -32768);
+	CHECK(sample<int16_t>(0.5 / 32768.) == 1); // rounds half away
+	CHECK(sample<int16_t>(-0.5 / 32768.) == -1);
+	CHECK(sample<int24>(1.).value == 8388607);
+	CHECK(sample<int32_t>(-2.) == std::numeric_limits<int32_t>::min());
+
+	// negotiation
+	sample_format_t f;
+	pcm_in<int16_t> p16;
+	out o;
+	control_in<float> c;
+	CHECK(sample_format_of(p16, f) && f == sample_format_t::s16);
+	CHECK(sample_format_of(o, f) && f == sample_format_t::f32);
+	CHECK(!sample_format_of(c, f));
+	CHECK(sample_size(sample_format_t::s24) == 4);
+
+	return test_result();
+}
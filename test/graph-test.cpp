@@ -0,0 +1,137 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file graph-test.cpp
+	graph::process() on multiple threads must respect all edges and
+	flush subnormals
+*/
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <spa/graph.h>
+
+#include "check.h"
+
+//! records when it has run, counting from 0 in each period
+class order_plugin : public spa::plugin
+{
+	std::atomic<unsigned>* clock;
+public:
+	std::atomic<unsigned> stamp, runs;
+
+	void run() override
+	{
+		// give other threads a chance to steal
+		for(volatile unsigned i = 0; i < 1000; ++i) ;
+		stamp.store(clock->fetch_add(1));
+		runs.fetch_add(1);
+	}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	order_plugin(std::atomic<unsigned>& clock) :
+		clock(&clock), stamp(0), runs(0) {}
+};
+
+//! records whether subnormals are flushed to zero while it runs
+class subnormal_plugin : public spa::plugin
+{
+public:
+	std::atomic<bool> flushed;
+	void run() override
+	{
+		volatile float tiny = 1e-37f;
+		tiny = tiny * 1e-3f; // subnormal, unless flushed
+		flushed = (tiny == 0.f);
+	}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+	subnormal_plugin() : flushed(false) {}
+};
+
+static void test_denormals()
+{
+	subnormal_plugin flushing, exact;
+	spa::graph g;
+	const spa::graph::node_id first = g.add(flushing);
+	g.connect(first, g.add(exact, true));
+	g.start(1);
+	g.process();
+	g.stop();
+#if defined(__SSE__) || defined(__x86_64__) || defined(__aarch64__)
+	CHECK(flushing.flushed);
+#endif
+	CHECK(!exact.flushed);
+}
+
+int main()
+{
+	// two diamonds in sequence, with a wide middle layer:
+	//   0 -> 1..4 -> 5 -> 6..9 -> 10
+	constexpr unsigned n = 11, periods = 1000;
+	std::atomic<unsigned> clock(0);
+	std::vector<std::unique_ptr<order_plugin>> plugins;
+	spa::graph g;
+	for(unsigned i = 0; i < n; ++i)
+	{
+		plugins.emplace_back(new order_plugin(clock));
+		CHECK(g.add(*plugins.back()) == i);
+	}
+	std::vector<std::pair<unsigned, unsigned>> edges;
+	for(unsigned i = 1; i <= 4; ++i)
+	{
+		edges.emplace_back(0, i);
+		edges.emplace_back(i, 5);
+		edges.emplace_back(5, i + 5);
+		edges.emplace_back(i + 5, 10);
+	}
+	for(const std::pair<unsigned, unsigned>& e : edges)
+		g.connect(e.first, e.second);
+
+	g.start(3);
+	CHECK(g.running());
+	CHECK(g.threads() == 4);
+	for(unsigned p = 0; p < periods; ++p)
+	{
+		clock.store(0);
+		g.process();
+		CHECK(clock.load() == n);
+		for(const std::pair<unsigned, unsigned>& e : edges)
+			CHECK(plugins[e.first]->stamp <
+				plugins[e.second]->stamp);
+	}
+	g.stop();
+	CHECK(!g.running());
+
+	for(const std::unique_ptr<order_plugin>& plug : plugins)
+		CHECK(plug->runs == periods);
+
+	// cycles are rejected
+	g.connect(10, 0);
+	bool thrown = false;
+	try { g.start(2); }
+	catch(const spa::exception& ) { thrown = true; }
+	CHECK(thrown);
+	CHECK(!g.running());
+
+	test_denormals();
+	return test_result();
+}
@@ -0,0 +1,93 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file idle-test.cpp
+	idle_tracker must skip a plugin once its tail has ended, and run it
+	again when new input arrives
+*/
+
+#include <spa/audio_host.h>
+
+#include "check.h"
+
+using namespace spa::audio;
+
+//! a decaying echo, which rings for 25 frames after its last input
+class echo_plugin : public spa::plugin
+{
+	unsigned ringing = 0;
+public:
+	tail tail_port;
+	bool input = false; //!< whether the current period has input
+	unsigned runs = 0;
+
+	void run() override
+	{
+		++runs;
+		ringing = input ? 25 : (ringing > 10 ? ringing - 10 : 0);
+		tail_port = ringing;
+	}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+};
+
+int main()
+{
+	echo_plugin plug;
+	idle_tracker idle;
+	idle.connect(plug.tail_port);
+	CHECK(!idle.is_idle());
+
+	// input in periods 0 and 10, 10 frames each
+	unsigned skipped = 0, first_skips = 0;
+	bool ran[16];
+	for(unsigned period = 0; period < 16; ++period)
+	{
+		plug.input = (period == 0 || period == 10);
+		ran[period] = idle.need_run(plug.input);
+		if(ran[period])
+		{
+			plug.run();
+			idle.ran();
+		}
+		else
+		{
+			++skipped;
+			first_skips += idle.first_skip();
+		}
+	}
+
+	// the tail of 25 frames lasts for the periods 1 and 2, and the
+	// run in period 3 reports that it has ended
+	for(unsigned p : { 0u, 1u, 2u, 3u, 10u, 11u, 12u, 13u })
+		CHECK(ran[p]);
+	for(unsigned p : { 4u, 5u, 6u, 7u, 8u, 9u, 14u, 15u })
+		CHECK(!ran[p]);
+	CHECK(plug.runs == 8);
+	CHECK(skipped == 8);
+	CHECK(first_skips == 2);
+	CHECK(idle.is_idle() && !idle.remaining());
+
+	// the host may wake it, e.g. after changing its state
+	idle.wake();
+	CHECK(idle.need_run(false));
+
+	return test_result();
+}
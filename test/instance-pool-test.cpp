@@ -0,0 +1,164 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file instance-pool-test.cpp
+	instance_pool must hand out prepared instances, grow on misses, shrink
+	after the decay period and respect the memory budget
+*/
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <spa/host.h>
+
+#include "check.h"
+
+//! does nothing
+class idle_plugin : public spa::plugin
+{
+public:
+	void run() override {}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+};
+
+//! counts the instances that the pool creates and disposes
+struct counter
+{
+	std::atomic<bool> open; //!< whether the factory may create instances
+	std::atomic<int> created, disposed;
+	std::atomic<spa::plugin*> last; //!< last created instance
+
+	counter() : open(true), created(0), disposed(0), last(nullptr) {}
+
+	spa::instance_pool::factory_t factory()
+	{
+		return [this]() -> spa::plugin* {
+			if(!open)
+				return nullptr;
+			spa::plugin* p = new idle_plugin;
+			last = p;
+			++created;
+			return p;
+		};
+	}
+	spa::instance_pool::disposer_t disposer()
+	{
+		return [this](spa::plugin* p) {
+			delete p;
+			++disposed;
+		};
+	}
+};
+
+//! poll @p done for up to 5 seconds
+static bool wait_for(const std::function<bool()>& done)
+{
+	for(int i = 0; i < 500 && !done(); ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	return done();
+}
+
+static void test_take_prepared()
+{
+	counter c;
+	{
+		spa::instance_pool pool(c.factory(), c.disposer(), 1, 100);
+		CHECK(wait_for([&]{ return pool.available() == 1; }));
+		spa::plugin* const prepared = c.last;
+		spa::plugin* const taken = pool.take();
+		// take() hands out the instance that the pool has prepared
+		CHECK(taken && taken == prepared);
+		c.disposer()(taken);
+		// and the pool prepares the next one
+		CHECK(wait_for([&]{ return pool.available() > 0; }));
+	}
+	CHECK(c.created == c.disposed);
+}
+
+static void test_grow_on_miss()
+{
+	counter c;
+	c.open = false;
+	{
+		spa::instance_pool pool(c.factory(), c.disposer(), 1, 100, 2);
+		CHECK(pool.target_size() == 2);
+		// nothing is ready, so the pool doubles its target
+		CHECK(pool.take() == nullptr);
+		CHECK(pool.target_size() == 4);
+		CHECK(pool.take() == nullptr);
+		CHECK(pool.target_size() == 8);
+
+		c.open = true;
+		CHECK(wait_for([&]{ return pool.available() == 8; }));
+	}
+	CHECK(c.created == 8 && c.disposed == 8);
+}
+
+static void test_decay()
+{
+	counter c;
+	{
+		spa::instance_pool pool(c.factory(), c.disposer(), 1, 100, 1,
+			std::chrono::seconds(1));
+		CHECK(wait_for([&]{ return pool.available() == 1; }));
+		// taking the last instance makes the pool grow by one
+		c.disposer()(pool.take());
+		CHECK(pool.target_size() == 2);
+		CHECK(wait_for([&]{ return pool.available() == 2; }));
+
+		// without take(), the pool shrinks back to its minimum
+		CHECK(wait_for([&]{ return pool.target_size() == 1 &&
+			pool.available() == 1; }));
+		CHECK(c.disposed == 2);
+	}
+	CHECK(c.created == 3 && c.disposed == 3);
+}
+
+static void test_memory_budget()
+{
+	counter c;
+	c.open = false;
+	{
+		// the budget only suffices for 3 instances, even though the
+		// minimum is higher
+		spa::instance_pool pool(c.factory(), c.disposer(), 100, 399,
+			10);
+		CHECK(pool.target_size() == 3);
+		CHECK(pool.take() == nullptr);
+		CHECK(pool.target_size() == 3);
+
+		c.open = true;
+		CHECK(wait_for([&]{ return pool.available() == 3; }));
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		CHECK(pool.available() == 3);
+	}
+	CHECK(c.created == 3 && c.disposed == 3);
+}
+
+int main()
+{
+	test_take_prepared();
+	test_grow_on_miss();
+	test_decay();
+	test_memory_budget();
+	return test_result();
+}
@@ -0,0 +1,118 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file port-bits-test.cpp
+	port_bitset, port_count() and mark_changed()
+*/
+
+#include <vector>
+#include <spa/host.h>
+
+#include "check.h"
+
+//! plugin which tracks changes of 100 ports
+class tracking_plugin : public spa::plugin
+{
+public:
+	spa::port_bits<100> changed;
+
+	void run() override {}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+	spa::port_bitset* changed_ports() override { return &changed; }
+};
+
+class untracked_plugin : public spa::plugin
+{
+public:
+	void run() override {}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+};
+
+class table_descriptor : public spa::descriptor
+{
+	SPA_DESCRIPTOR
+	const char* const* table;
+public:
+	table_descriptor(const char* const* table) : table(table) {}
+
+	hoster_t hoster() const override { return hoster_t::localhost; }
+	const char* organization_url() const override { return "test"; }
+	const char* project_url() const override { return "test"; }
+	const char* label() const override { return "port-bits"; }
+	const char* project() const override { return "test"; }
+	const char* name() const override { return "port bits test"; }
+	license_type license() const override {
+		return license_type::gpl_3_0; }
+	spa::plugin* instantiate() const override { return nullptr; }
+	spa::simple_vec<spa::simple_str> port_names() const override {
+		return {}; }
+	const char* const* port_table() const override { return table; }
+};
+
+static void test_bitset()
+{
+	spa::port_bits<130> bits;
+	CHECK(bits.size() == 192);
+	CHECK(!bits.any());
+
+	const unsigned set[] = { 129, 0, 63, 64, 5, 127 };
+	for(unsigned idx : set)
+		bits.set(idx);
+	CHECK(bits.any());
+	CHECK(bits.test(63) && bits.test(64) && !bits.test(65));
+	bits.reset(5);
+	CHECK(!bits.test(5));
+
+	std::vector<unsigned> seen;
+	bits.consume([&](unsigned idx) { seen.push_back(idx); });
+	CHECK((seen == std::vector<unsigned>{ 0, 63, 64, 127, 129 }));
+	CHECK(!bits.any());
+
+	bits.set(7);
+	bits.clear();
+	seen.clear();
+	bits.consume([&](unsigned idx) { seen.push_back(idx); });
+	CHECK(seen.empty());
+}
+
+static void test_host_helpers()
+{
+	const char* const names[] = { "/in", "/out", "/gain", nullptr };
+	CHECK(spa::port_count(table_descriptor(names)) == 3);
+	CHECK(spa::port_count(table_descriptor(nullptr)) == 0);
+
+	tracking_plugin tracking;
+	spa::mark_changed(tracking, 2);
+	spa::mark_changed(tracking, 99);
+	CHECK(tracking.changed.test(2) && tracking.changed.test(99));
+	CHECK(!tracking.changed.test(3));
+
+	untracked_plugin untracked;
+	spa::mark_changed(untracked, 2); // must be a no-op
+}
+
+int main()
+{
+	test_bitset();
+	test_host_helpers();
+	return test_result();
+}
@@ -0,0 +1,74 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file rtcheck-test.cpp
+	runs a plugin that breaks its realtime promise in an rt_scope
+
+	Usage: rtcheck-test [clean|malloc|aligned|stdio|iostream|fopen]
+	If the RT-safety checker (see rtcheck.h) is preloaded, all modes except
+	"clean" must make it report a violation on stderr, and the test then
+	returns failure.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <spa/rtcheck.h>
+#include <spa/spa.h>
+
+class bad_plugin : public spa::plugin
+{
+	const char* mode;
+public:
+	void* volatile leak = nullptr;
+
+	void run() override
+	{
+		if(!std::strcmp(mode, "malloc"))
+			leak = std::malloc(64);
+		else if(!std::strcmp(mode, "aligned"))
+			leak = aligned_alloc(64, 64);
+		else if(!std::strcmp(mode, "stdio"))
+			std::fwrite("run\n", 1, 4, stderr);
+		else if(!std::strcmp(mode, "iostream"))
+			std::cerr << "run" << std::endl;
+		else if(!std::strcmp(mode, "fopen"))
+			leak = std::fopen("/dev/null", "r");
+	}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	bad_plugin(const char* mode) : mode(mode) {}
+};
+
+int main(int argc, char** argv)
+{
+	bad_plugin plug(argc > 1 ? argv[1] : "clean");
+	{
+		spa::rt_scope rt("bad-plugin");
+		plug.run();
+	}
+	if(!std::strcmp(argc > 1 ? argv[1] : "", "fopen") && plug.leak)
+		std::fclose(static_cast<FILE*>(plug.leak));
+	else
+		std::free(plug.leak);
+	return spa::rt_violations() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
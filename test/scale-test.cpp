@@ -0,0 +1,153 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file scale-test.cpp
+	error bounds of fast_log2 and fast_exp2, and round trips of scale_map
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <spa/audio_scale.h>
+
+#include "check.h"
+
+using namespace spa::audio;
+
+//! largest absolute error of fast_log2 for x in [lo, hi]
+static double log2_error(float lo, float hi)
+{
+	double max_err = 0.0;
+	for(float x = lo; x <= hi && x < FLT_MAX / 1.001f; x *= 1.001f)
+	{
+		const double err = std::fabs(fast_log2(x) -
+			std::log2(static_cast<double>(x)));
+		max_err = std::max(max_err, err);
+	}
+	return max_err;
+}
+
+static void test_fast_log2()
+{
+	CHECK(log2_error(0.00390625f, 256.0f) < 4e-7);
+	CHECK(log2_error(FLT_MIN, FLT_MAX) < 4e-6);
+	CHECK(fast_log2(1.0f) == 0.0f);
+	CHECK(fast_log2(1024.0f) == 10.0f);
+}
+
+static void test_fast_exp2()
+{
+	double max_err = 0.0;
+	for(float x = -126.0f; x <= 127.0f; x += 0.001f)
+	{
+		const double ref = std::exp2(static_cast<double>(x));
+		max_err = std::max(max_err,
+			std::fabs(fast_exp2(x) - ref) / ref);
+	}
+	CHECK(max_err < 3e-7);
+	CHECK(fast_exp2(-1000.0f) == fast_exp2(-126.0f));
+}
+
+//! largest error of normalized -> value -> normalized over [0, 1]
+template<class T>
+static double round_trip_error(const scale_map<T>& map)
+{
+	double max_err = 0.0;
+	for(int i = 0; i <= 1000; ++i)
+	{
+		const float n = i / 1000.0f;
+		max_err = std::max(max_err, static_cast<double>(
+			std::fabs(map.to_normalized(map.to_value(n)) - n)));
+	}
+	return max_err;
+}
+
+static void test_linear()
+{
+	scale_map<float> map(scale_type_t::linear, -10.0f, 10.0f);
+	CHECK(map.to_value(0.0f) == -10.0f);
+	CHECK(map.to_value(0.5f) == 0.0f);
+	CHECK(map.to_value(1.0f) == 10.0f);
+	CHECK(map.to_value(2.0f) == 10.0f);
+	CHECK(map.to_normalized(5.0f) == 0.75f);
+	CHECK(round_trip_error(map) < 1e-6);
+
+	float normalized[3] = { 0.0f, 0.25f, 1.0f }, values[3];
+	map.to_values(normalized, values, 3);
+	CHECK(values[0] == -10.0f && values[1] == -5.0f && values[2] == 10.0f);
+}
+
+static void test_logarithmic()
+{
+	scale_map<float> map(scale_type_t::logartihmic, 20.0f, 20000.0f);
+	CHECK(std::fabs(map.to_value(0.0f) - 20.0f) < 1e-4f);
+	CHECK(std::fabs(map.to_value(1.0f) - 20000.0f) < 1e-2f);
+	// the geometric mean is in the middle
+	CHECK(std::fabs(map.to_value(0.5f) - std::sqrt(20.0f * 20000.0f))
+		< 1e-3f);
+	CHECK(round_trip_error(map) < 1e-6);
+
+	bool thrown = false;
+	try { scale_map<float> bad(scale_type_t::logartihmic, 0.0f, 1.0f); }
+	catch(const spa::exception&) { thrown = true; }
+	CHECK(thrown);
+}
+
+static void test_step()
+{
+	scale_map<float> map(scale_type_t::linear, 1.0f, 2.0f, 0.25f);
+	CHECK(map.to_value(0.0f) == 1.0f);
+	CHECK(map.to_value(0.3f) == 1.25f);
+	CHECK(map.to_value(0.4f) == 1.5f);
+	CHECK(map.to_value(1.0f) == 2.0f);
+
+	// integers are rounded to the nearest value
+	scale_map<int> midi(scale_type_t::linear, 0, 127);
+	CHECK(midi.to_value(0.5f) == 64);
+	for(int v = 0; v <= 127; ++v)
+		CHECK(midi.to_value(midi.to_normalized(v)) == v);
+}
+
+static void test_default_range()
+{
+	// the default range of control_in<double> exceeds floats
+	control_in<double> port;
+	scale_map<double> map(port);
+	CHECK(std::isfinite(map.to_value(0.0f)));
+	CHECK(std::isfinite(map.to_value(1.0f)));
+	CHECK(map.to_value(1.0f) > 0.0);
+	CHECK(std::isfinite(map.to_normalized(DBL_MAX)));
+
+	bool thrown = false;
+	try { scale_map<double> bad(scale_type_t::linear, NAN, 1.0); }
+	catch(const spa::exception&) { thrown = true; }
+	CHECK(thrown);
+}
+
+int main()
+{
+	test_fast_log2();
+	test_fast_exp2();
+	test_linear();
+	test_logarithmic();
+	test_step();
+	test_default_range();
+	return test_result();
+}
@@ -0,0 +1,202 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file snapshot-test.cpp
+	snapshot_view must reject malformed snapshots, e.g. from corrupted
+	files, instead of reading out of bounds, and must tell plugins which
+	ports a restore has changed
+*/
+
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <spa/host.h>
+
+#include "check.h"
+
+//! plugin with 12 bytes of state
+class state_plugin : public spa::plugin
+{
+public:
+	char state[12] = "hello world";
+
+	void run() override {}
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+	std::size_t snapshot_save(void* buffer, std::size_t size) override
+	{
+		if(size >= sizeof(state))
+			std::memcpy(buffer, state, sizeof(state));
+		return sizeof(state);
+	}
+	bool snapshot_load(const void* buffer, std::size_t size) override
+	{
+		if(size != sizeof(state))
+			return false;
+		std::memcpy(state, buffer, sizeof(state));
+		return true;
+	}
+};
+
+struct controls_t { float gain, pan; int mode; float pad; };
+
+//! a copy of a snapshot, whose header can be modified
+class copy
+{
+	std::vector<uint64_t> storage;
+public:
+	spa::snapshot_header& header() {
+		return *reinterpret_cast<spa::snapshot_header*>(
+			storage.data()); }
+	const char* data() const {
+		return reinterpret_cast<const char*>(storage.data()); }
+	std::size_t size() const { return storage.size() * 8; }
+	bool valid() const {
+		return spa::snapshot_view(data(), size()).valid(); }
+	copy(const spa::snapshot& snap) : storage(snap.size() / 8) {
+		std::memcpy(storage.data(), snap.data(), snap.size()); }
+};
+
+static void test_headers(const spa::snapshot& snap)
+{
+	const uint64_t max = std::numeric_limits<uint64_t>::max();
+
+	CHECK(copy(snap).valid());
+	CHECK(snap.view().valid());
+	// truncated, or not aligned
+	CHECK(!spa::snapshot_view(snap.data(), snap.size() - 8).valid());
+	CHECK(!spa::snapshot_view(snap.data(), 16).valid());
+	{
+		std::vector<uint64_t> shifted(snap.size() / 8 + 1);
+		char* unaligned = reinterpret_cast<char*>(shifted.data()) + 4;
+		std::memcpy(unaligned, snap.data(), snap.size());
+		CHECK(!spa::snapshot_view(unaligned, snap.size()).valid());
+	}
+
+	{ copy c(snap); c.header().magic[0] = 'x'; CHECK(!c.valid()); }
+	{ copy c(snap); ++c.header().version; CHECK(!c.valid()); }
+	{ copy c(snap); c.header().header_size = 8; CHECK(!c.valid()); }
+	{ copy c(snap); c.header().total_size += 8; CHECK(!c.valid()); }
+	// offset + size wraps around to a small number
+	{
+		copy c(snap);
+		c.header().controls_offset = max - 7;
+		c.header().controls_size = 16;
+		CHECK(!c.valid());
+	}
+	{
+		copy c(snap);
+		c.header().state_size = max;
+		CHECK(!c.valid());
+	}
+	{ copy c(snap); c.header().state_offset += 4; CHECK(!c.valid()); }
+	// sections overlapping the header
+	{ copy c(snap); c.header().controls_offset = 0; CHECK(!c.valid()); }
+}
+
+static void test_slots(const spa::snapshot& snap)
+{
+	controls_t controls { 0.5f, 0.f, 3, 0.f };
+	// slots that would wrap around in 32 bit
+	const spa::control_slot slots[] = {
+		{ 0, 0, 4 },
+		{ 1, 0xfffffffc, 8 },
+		{ 2, 8, 0xfffffffc },
+		{ 3, 12, 8 } // beyond the end
+	};
+	spa::port_bits<4> changed;
+	CHECK(snap.view().restore_controls(&controls, sizeof(controls),
+		slots, 4, &changed) == 1);
+	CHECK(controls.gain == 1.f);
+	CHECK(controls.mode == 3);
+	CHECK(changed.test(0) && !changed.test(1) && !changed.test(2) &&
+		!changed.test(3));
+	CHECK(snap.view().restore_controls(&controls, 8, slots, 4,
+		nullptr) == -1);
+}
+
+//! records the calls of restore_changed()
+class restore_plugin : public state_plugin
+{
+public:
+	unsigned calls = 0;
+	bool got_ports = false;
+	bool port_changed[4] = {};
+
+	void restore_changed(uint64_t ticket, const spa::port_bitset* ports,
+		const char* const* paths) override
+	{
+		CHECK(ticket == 42);
+		CHECK(!paths);
+		++calls;
+		got_ports = ports;
+		for(unsigned i = 0; ports && i < 4; ++i)
+			port_changed[i] = ports->test(i);
+	}
+};
+
+static void test_restore_changed(const spa::snapshot& snap)
+{
+	const spa::control_slot slots[] = {
+		{ 0, 0, 4 }, { 1, 4, 4 }, { 2, 8, 4 }, { 3, 12, 4 } };
+	spa::port_bits<4> changed;
+	changed.set(3); // stale bits must be cleared
+
+	restore_plugin plug;
+	std::memset(plug.state, 0, sizeof(plug.state));
+	controls_t controls { 1.f, 0.f, 2, 0.f }; // only pan differs
+	CHECK(snap.restore(plug, &controls, sizeof(controls), slots, 4,
+		changed, 42));
+	CHECK(!std::strcmp(plug.state, "hello world"));
+	CHECK(controls.pan == -1.f);
+	CHECK(plug.calls == 1 && plug.got_ports);
+	CHECK(!plug.port_changed[0] && plug.port_changed[1] &&
+		!plug.port_changed[2] && !plug.port_changed[3]);
+
+	// nothing has changed now
+	CHECK(snap.restore(plug, &controls, sizeof(controls), slots, 4,
+		changed, 42));
+	CHECK(plug.calls == 2 && !plug.got_ports);
+
+	// the plugin is not told anything if the snapshot does not match
+	CHECK(!snap.restore(plug, &controls, 8, slots, 4, changed, 42));
+	CHECK(plug.calls == 2);
+}
+
+int main()
+{
+	state_plugin plug;
+	const controls_t controls { 1.f, -1.f, 2, 0.f };
+	spa::snapshot snap;
+	snap.capture(plug, &controls, sizeof(controls));
+
+	test_headers(snap);
+	test_slots(snap);
+	test_restore_changed(snap);
+
+	state_plugin other;
+	std::memset(other.state, 0, sizeof(other.state));
+	controls_t restored {};
+	CHECK(snap.restore(other, &restored, sizeof(restored)));
+	CHECK(!std::strcmp(other.state, "hello world"));
+	CHECK(!std::memcmp(&restored, &controls, sizeof(controls)));
+
+	return test_result();
+}
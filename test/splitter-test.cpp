@@ -0,0 +1,157 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file splitter-test.cpp
+	block_splitter with and without a samplecount port, with interleaved
+	busses, and with aligned and padded ports
+*/
+
+#include <cstdint>
+#include <vector>
+#include <spa/audio_host.h>
+
+#include "check.h"
+
+using namespace spa::audio;
+
+//! records the buffers and sizes of each run
+class record_plugin : public spa::plugin
+{
+public:
+	stereo::in in;
+	bus::out bus_out;
+	unsigned* count = nullptr; //!< the samplecount, if connected
+	struct call { const float* left; float* bus; unsigned frames; };
+	std::vector<call> calls;
+
+	void run() override {
+		calls.push_back({in.left, bus_out.interleaved_buffer(),
+			count ? *count : 0u}); }
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	record_plugin() {
+		bus_out.channels = 2;
+		bus_out.layouts = bus::interleaved; }
+};
+
+int main()
+{
+	const unsigned period = 64;
+	aligned_buffer<float> left, right, interleaved;
+	left.resize(period);
+	right.resize(period);
+	interleaved.resize(2 * period);
+	unsigned samplecount = 0;
+	const unsigned splits[] = { 0, 16, 40, 100 };
+	std::vector<unsigned> firsts;
+	auto on_block = [&](unsigned first, unsigned ) {
+		firsts.push_back(first); };
+
+	record_plugin plug;
+	plug.in.left = left.data();
+	plug.in.right = right.data();
+	plug.bus_out.connect_interleaved(interleaved.data());
+
+	block_splitter splitter;
+	splitter.add(plug.in);
+	splitter.add(plug.bus_out);
+
+	// no samplecount port: one whole period, events quantised to it
+	CHECK(!splitter.splits());
+	splitter.run(plug, samplecount, period, splits, 4, on_block);
+	CHECK(plug.calls.size() == 1);
+	CHECK(plug.calls[0].left == left.data());
+	CHECK(firsts.size() == 1 && firsts[0] == 0);
+
+	// with samplecount: split at 16 and 40, the others are ignored
+	spa::audio::samplecount count_port;
+	count_port.set_ref(&samplecount);
+	splitter.add(count_port);
+	plug.count = &samplecount;
+	plug.calls.clear();
+	firsts.clear();
+	splitter.run(plug, samplecount, period, splits, 4, on_block);
+	CHECK(splitter.splits());
+	CHECK(plug.calls.size() == 3);
+	if(plug.calls.size() == 3)
+	{
+		const unsigned first[] = { 0, 16, 40 },
+			frames[] = { 16, 24, 24 };
+		for(unsigned i = 0; i < 3; ++i)
+		{
+			CHECK(plug.calls[i].left == left.data() + first[i]);
+			CHECK(plug.calls[i].bus ==
+				interleaved.data() + 2 * first[i]);
+			CHECK(plug.calls[i].frames == frames[i]);
+			CHECK(firsts[i] == first[i]);
+		}
+	}
+	// the pointers are restored for the next period
+	CHECK(plug.in.left == left.data());
+	CHECK(plug.bus_out.interleaved_buffer() == interleaved.data());
+
+	// an input for AVX: splits are rounded down to 8 frames, so each
+	// sub-block starts 32 byte aligned and does not end inside padding
+	in avx;
+	avx.require_simd(32);
+	avx.set_ref(left.data());
+	splitter.add(avx);
+	CHECK(splitter.granularity() == 8);
+	const unsigned unaligned[] = { 5, 12, 20, 30 };
+	plug.calls.clear();
+	firsts.clear();
+	splitter.run(plug, samplecount, period, unaligned, 4, on_block);
+	CHECK(plug.calls.size() == 4);
+	if(plug.calls.size() == 4)
+	{
+		const unsigned first[] = { 0, 8, 16, 24 },
+			frames[] = { 8, 8, 8, 40 };
+		for(unsigned i = 0; i < 4; ++i)
+		{
+			CHECK(plug.calls[i].left == left.data() + first[i]);
+			CHECK(!(reinterpret_cast<uintptr_t>(
+				plug.calls[i].left) % 32));
+			CHECK(plug.calls[i].frames == frames[i]);
+			CHECK(firsts[i] == first[i]);
+		}
+	}
+	CHECK(avx.get_ref() == left.data());
+
+	// clear() forgets the samplecount port and the granularity, too
+	splitter.clear();
+	CHECK(!splitter.splits());
+	CHECK(splitter.granularity() == 1);
+
+	// planar busses must be added by their channel pointers
+	bus::in planar;
+	planar.channels = 2;
+	const float* channels[] = { left.data(), right.data() };
+	planar.connect_planar(channels);
+	bool thrown = false;
+	try {
+		splitter.add(planar);
+	} catch(const spa::exception& ) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	return test_result();
+}
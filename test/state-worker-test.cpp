@@ -0,0 +1,206 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file state-worker-test.cpp
+	state_worker must save and load without calling save() or load() on
+	the instance that the audio thread runs
+*/
+
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <spa/host.h>
+
+#include "check.h"
+
+//! the "files", shared by all instances
+std::mutex files_mutex;
+std::map<std::string, int> files;
+
+//! counts its runs, which is all its state
+class counter_plugin : public spa::plugin
+{
+public:
+	std::atomic<int> count; //!< read by the test while running
+	std::atomic<bool> running; //!< whether the audio thread runs it
+	std::atomic<bool> misused; //!< save() or load() while running
+
+	void run() override {
+		count.store(count.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed); }
+	spa::port_ref_base& port(const char* path) override {
+		throw spa::port_not_found(path); }
+
+	bool save(const char* savefile, uint64_t ) override
+	{
+		misused = misused || running;
+		std::lock_guard<std::mutex> lock(files_mutex);
+		files[savefile] = count;
+		return true;
+	}
+	bool save_check(const char* , uint64_t ) override { return true; }
+	bool load(const char* savefile, uint64_t ) override
+	{
+		misused = misused || running;
+		std::lock_guard<std::mutex> lock(files_mutex);
+		auto itr = files.find(savefile);
+		if(itr == files.end())
+			return false;
+		count = itr->second;
+		return true;
+	}
+	bool load_check(const char* , uint64_t ) override { return true; }
+
+	std::size_t snapshot_save(void* buffer, std::size_t size) override
+	{
+		const int value = count;
+		if(size >= sizeof(value))
+			std::memcpy(buffer, &value, sizeof(value));
+		return sizeof(value);
+	}
+	bool snapshot_load(const void* buffer, std::size_t size) override
+	{
+		int value;
+		if(size != sizeof(value))
+			return false;
+		std::memcpy(&value, buffer, sizeof(value));
+		count = value;
+		return true;
+	}
+
+	counter_plugin() : count(0), running(false), misused(false) {}
+};
+
+class counter_descriptor : public spa::descriptor
+{
+	SPA_DESCRIPTOR
+	bool snapshots;
+public:
+	counter_descriptor(bool snapshots) : snapshots(snapshots) {}
+
+	hoster_t hoster() const override { return hoster_t::localhost; }
+	const char* organization_url() const override { return "test"; }
+	const char* project_url() const override { return "test"; }
+	const char* label() const override { return "counter"; }
+	const char* project() const override { return "test"; }
+	const char* name() const override { return "counter"; }
+	license_type license() const override {
+		return license_type::gpl_3_0; }
+	counter_plugin* instantiate() const override {
+		return new counter_plugin; }
+	spa::simple_vec<spa::simple_str> port_names() const override {
+		return {}; }
+	bool save_has() const override { return true; }
+	bool load_has() const override { return true; }
+	bool snapshot_has() const override { return snapshots; }
+};
+
+//! the audio thread, running a state_worker until it is stopped
+class audio_thread
+{
+	std::atomic<bool> quit;
+public:
+	//! the instance run last, initialized before the thread starts
+	std::atomic<counter_plugin*> last;
+private:
+	std::thread thread;
+public:
+	audio_thread(spa::state_worker& worker) :
+		quit(false),
+		last(nullptr),
+		thread([this, &worker] {
+			while(!quit)
+			{
+				counter_plugin& plug =
+					static_cast<counter_plugin&>(
+						worker.acquire());
+				last = &plug;
+				plug.running = true;
+				plug.run();
+				plug.running = false;
+			}
+		}) {}
+	~audio_thread() { quit = true; thread.join(); }
+};
+
+static void test_save_load()
+{
+	const counter_descriptor desc(true);
+	counter_plugin* first = desc.instantiate();
+	std::atomic<unsigned> disposed(0);
+	spa::state_worker worker(desc, *first,
+		[&]{ return desc.instantiate(); },
+		[&](spa::plugin* p) { ++disposed; delete p; });
+
+	uint64_t saved, loaded;
+	{
+		audio_thread audio(worker);
+		while(first->count < 1000)
+			std::this_thread::yield();
+		saved = worker.save("a");
+		CHECK(worker.wait(saved) == spa::state_worker::status_t::done);
+	}
+	{
+		std::lock_guard<std::mutex> lock(files_mutex);
+		CHECK(files["a"] >= 1000 && files["a"] <= first->count);
+		files["b"] = -1000000;
+	}
+	CHECK(!first->misused);
+	CHECK(disposed == 1); // the instance that saved
+
+	{
+		audio_thread audio(worker);
+		loaded = worker.load("b");
+		CHECK(worker.wait(loaded) == spa::state_worker::status_t::done);
+		CHECK(worker.wait(worker.load("none")) ==
+			spa::state_worker::status_t::failed);
+		// the new instance starts at -1000000
+		while(audio.last == first)
+			std::this_thread::yield();
+	}
+	counter_plugin& second =
+		static_cast<counter_plugin&>(worker.running());
+	CHECK(&second != first);
+	CHECK(second.count < 0);
+	CHECK(!second.misused);
+	CHECK(disposed == 3); // the old one and the one that failed to load
+	delete &second;
+}
+
+static void test_no_snapshots()
+{
+	const counter_descriptor desc(false);
+	counter_plugin* plug = desc.instantiate();
+	spa::state_worker worker(desc, *plug,
+		[&]{ return desc.instantiate(); },
+		[&](spa::plugin* p) { delete p; });
+	CHECK(worker.wait(worker.save("c")) ==
+		spa::state_worker::status_t::failed);
+	delete plug;
+}
+
+int main()
+{
+	test_save_load();
+	test_no_snapshots();
+	return test_result();
+}
@@ -0,0 +1,94 @@
+/*************************************************************************/
+/* spa - simple plugin API                                               */
+/* Copyright (C) 2018                                                    */
+/* Johannes Lorenz (j.git$$$lorenz-ho.me, $$$=@)                         */
+/*                                                                       */
+/* This program is free software; you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation; either version 3 of the License, or (at */
+/* your option) any later version.                                       */
+/* This program is distributed in the hope that it will be useful, but   */
+/* WITHOUT ANY WARRANTY; without even the implied warranty of            */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU      */
+/* General Public License for more details.                              */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program; if not, write to the Free Software           */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA  */
+/*************************************************************************/
+
+/**
+	@file visitor-test.cpp
+	visitor_cast() with visitors of multiple libraries, colliding ids,
+	visitors without SPA_VISITOR and copied visitors
+*/
+
+#include <spa/audio.h>
+
+#include "check.h"
+
+namespace other_lib {
+
+//! visitor of another library, which happens to use the same id as
+//! spa::audio::visitor
+class visitor : public virtual spa::visitor
+{
+public:
+	SPA_VISITOR(1, spa::visitor)
+	using spa::visitor::visit;
+};
+
+//! visitor of a library that does not use SPA_VISITOR
+class plain_visitor : public virtual spa::visitor {};
+
+}
+
+//! host visitor for the ports of both libraries
+struct mixed_visitor : public virtual spa::audio::visitor,
+	public virtual other_lib::visitor
+{
+	using spa::audio::visitor::visit;
+};
+
+struct plain_host_visitor : public virtual other_lib::plain_visitor,
+	public virtual spa::audio::visitor {};
+
+template<class V>
+bool casts_to(spa::visitor& v, void* expected)
+{
+	try { return &spa::visitor_cast<V>(v) == expected; }
+	catch(const spa::exception& ) { return false; }
+}
+
+int main()
+{
+	mixed_visitor mixed;
+	spa::visitor& base = mixed;
+	CHECK(casts_to<spa::audio::visitor>(base,
+		static_cast<spa::audio::visitor*>(&mixed)));
+	CHECK(casts_to<other_lib::visitor>(base,
+		static_cast<other_lib::visitor*>(&mixed)));
+	CHECK(casts_to<mixed_visitor>(base, &mixed));
+	CHECK(!casts_to<other_lib::plain_visitor>(base, nullptr));
+
+	// copies are found as well
+	mixed_visitor copy(mixed);
+	CHECK(casts_to<other_lib::visitor>(copy,
+		static_cast<other_lib::visitor*>(&copy)));
+
+	plain_host_visitor plain;
+	CHECK(casts_to<other_lib::plain_visitor>(plain,
+		static_cast<other_lib::plain_visitor*>(&plain)));
+	CHECK(casts_to<spa::audio::visitor>(plain,
+		static_cast<spa::audio::visitor*>(&plain)));
+
+	// only the audio visitor may visit audio ports
+	other_lib::visitor other;
+	spa::audio::control_in<float> port;
+	bool thrown = false;
+	try { port.accept(other); }
+	catch(const spa::exception& ) { thrown = true; }
+	CHECK(thrown);
+
+	return test_result();
+}